@@ -0,0 +1,161 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <memory_resource>
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+
+
+const size_t ARENA_CHUNK_BYTES = 64 * 1024; //每块64KB，第一次分配时才申请
+const size_t ARENA_RETAIN_BYTES = 1024 * 1024; //reset后最多保留的块的总大小，偶尔一次的大分配不会一直占着内存
+
+
+/*
+ 任务内存区：每个工作线程一个，分配只是在当前块里移动指针，不加锁、不经过malloc
+ deallocate什么都不做，任务返回后线程池调用reset()整体回收，块留着给下一个任务用
+ 只能在拥有它的线程上使用；分配的内存只在当前任务返回前有效，不能放进任务结果、也不能跨co_await保存
+*/
+class TaskArena : public std::pmr::memory_resource
+{
+public:
+    explicit TaskArena(size_t chunkBytes = ARENA_CHUNK_BYTES)
+        :chunkBytes_(chunkBytes)
+        ,current_(0)
+        ,ptr_(nullptr)
+        ,end_(nullptr)
+        ,used_(0)
+        ,chunkTotal_(0)
+    {}
+
+    TaskArena(const TaskArena&) = delete;
+    TaskArena& operator=(const TaskArena&) = delete;
+
+    ~TaskArena() override
+    {
+        for(Chunk& chunk : chunks_)
+        {
+            std::free(chunk.data);
+        }
+    }
+
+    //回收这次以来分配的所有内存，没有分配过、块也没有超过保留上限时什么都不做
+    //从头保留不超过ARENA_RETAIN_BYTES的块，其余的还给malloc
+    //rewind之后used_可能回到0，而嵌套任务新申请的块还在，所以还要看块的总大小
+    void reset()
+    {
+        if(used_ == 0 && chunkTotal_ <= ARENA_RETAIN_BYTES) return;
+        size_t kept = 0;
+        size_t retained = 0;
+        for(Chunk& chunk : chunks_)
+        {
+            if(retained + chunk.size <= ARENA_RETAIN_BYTES)
+            {
+                retained += chunk.size;
+                chunks_[kept++] = chunk;
+            }
+            else
+            {
+                std::free(chunk.data);
+            }
+        }
+        chunks_.resize(kept);
+        chunkTotal_ = retained;
+        current_ = 0;
+        ptr_ = kept > 0 ? chunks_[0].data : nullptr;
+        end_ = kept > 0 ? chunks_[0].data + chunks_[0].size : nullptr;
+        used_ = 0;
+    }
+
+    //上次reset以来分配出去的字节数
+    size_t used() const { return used_; }
+
+    //分配位置的快照：等待future时帮忙执行的嵌套任务返回后回到这里，只回收它分配的内存，外层任务的还在用
+    struct Mark
+    {
+        size_t current;
+        char* ptr;
+        char* end;
+        size_t used;
+    };
+
+    Mark mark() const
+    {
+        return Mark{current_, ptr_, end_, used_};
+    }
+
+    //回到mark时的位置，之后新申请的块留着继续用，到reset时再按ARENA_RETAIN_BYTES处理(即使回到了没有分配过的状态)
+    //新块只会插在当时的当前块后面，mark记下的块下标不变
+    void rewind(const Mark& m)
+    {
+        current_ = m.current;
+        ptr_ = m.ptr;
+        end_ = m.end;
+        used_ = m.used;
+    }
+
+private:
+    struct Chunk
+    {
+        char* data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        char* p = alignUp(ptr_, alignment);
+        if(p == nullptr || p + bytes > end_)
+        {
+            p = alignUp(nextChunk(bytes + alignment), alignment);
+        }
+        ptr_ = p + bytes;
+        used_ += bytes;
+        return p;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    static char* alignUp(char* p, size_t alignment)
+    {
+        if(p == nullptr) return nullptr;
+        uintptr_t v = reinterpret_cast<uintptr_t>(p);
+        return p + ((alignment - (v & (alignment - 1))) & (alignment - 1));
+    }
+
+    //切到下一个放得下need字节的块：后面保留的块够大就用它，否则新申请一块插在当前块后面
+    char* nextChunk(size_t need)
+    {
+        size_t next = ptr_ == nullptr ? 0 : current_ + 1;
+        if(next >= chunks_.size() || chunks_[next].size < need)
+        {
+            size_t size = need > chunkBytes_ ? need : chunkBytes_;
+            char* data = static_cast<char*>(std::malloc(size));
+            if(data == nullptr) throw std::bad_alloc();
+            chunks_.insert(chunks_.begin() + next, Chunk{data, size});
+            chunkTotal_ += size;
+        }
+        current_ = next;
+        ptr_ = chunks_[next].data;
+        end_ = ptr_ + chunks_[next].size;
+        return ptr_;
+    }
+
+    const size_t chunkBytes_;
+    std::vector<Chunk> chunks_; //[0, current_]是这次分配用过的块
+    size_t current_; //正在分配的块
+    char* ptr_; //当前块里下一个空闲位置，还没有块时为nullptr
+    char* end_;
+    size_t used_;
+    size_t chunkTotal_; //所有块的总大小
+};
+
+
+#endif
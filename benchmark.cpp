@@ -0,0 +1,1258 @@
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <atomic>
+#include <new>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <map>
+#include <sys/resource.h>
+
+#include "improved_threadpool.h"
+#include "parallel_algorithms.h"
+#include "pool_group.h"
+#ifdef __cpp_impl_coroutine
+#include "coroutine.h"
+#endif
+
+/*
+ 线程池性能测试
+ 用法：./benchmark [用例名]，不带参数运行全部用例
+ coroutine用例需要用-std=c++20编译
+ ./benchmark suite [text|csv|json] [最大线程数] [标签]
+   各种负载 x 各种模式 x 1..N个线程，csv/json输出用来对比不同版本的线程池，标签写进每条结果
+*/
+
+//统计整个进程的堆分配次数，用来验证提交任务是否走了malloc
+static std::atomic<long> g_allocCount(0);
+
+void* operator new(size_t size)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    g_allocCount.fetch_add(1, std::memory_order_relaxed);
+    size_t a = (size_t)align;
+    if(void* p = std::aligned_alloc(a, (size + a - 1) / a * a)) return p;
+    throw std::bad_alloc();
+}
+
+//不内联：内联后编译器会把new出来的指针传给free当成不匹配的释放
+__attribute__((noinline)) static void rawFree(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p) noexcept { rawFree(p); }
+void operator delete(void* p, size_t) noexcept { rawFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { rawFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { rawFree(p); }
+
+struct CtxSwitches
+{
+    long voluntary;
+    long involuntary;
+};
+
+//整个进程(所有线程)的上下文切换次数
+static CtxSwitches readCtxSwitches()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return CtxSwitches{ru.ru_nvcsw, ru.ru_nivcsw};
+}
+
+static const char* modeName(PoolMode mode)
+{
+    switch(mode)
+    {
+    case PoolMode::MODE_FIXED: return "fixed";
+    case PoolMode::MODE_CACHED: return "cached";
+    case PoolMode::MODE_WORKSTEALING: return "workstealing";
+    }
+    return "?";
+}
+
+//唤醒开销：每轮突发提交一批空任务，轮与轮之间停一下让工作线程都挂起
+//统计吞吐量和上下文切换次数，notify_all惊群会表现为大量的自愿切换
+static void benchWakeup()
+{
+    const int rounds = 200;
+    const int burst = 64;
+    const int threads = 8;
+
+    for(PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED, PoolMode::MODE_WORKSTEALING})
+    {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(threads);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        CtxSwitches before = readCtxSwitches();
+        auto begin = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration idle(0);
+
+        std::vector<Future<void>> futs;
+        futs.reserve(burst);
+        for(int r = 0; r < rounds; r++)
+        {
+            futs.clear();
+            for(int i = 0; i < burst; i++)
+            {
+                futs.emplace_back(pool.submitTask([](){}));
+            }
+            for(auto& f : futs) f.get();
+
+            auto pause = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            idle += std::chrono::steady_clock::now() - pause;
+        }
+
+        auto busy = std::chrono::steady_clock::now() - begin - idle;
+        CtxSwitches after = readCtxSwitches();
+        double sec = std::chrono::duration<double>(busy).count();
+        long tasks = (long)rounds * burst;
+
+        std::printf("wakeup mode=%s threads=%d tasks=%ld tasks_per_sec=%.0f vol_csw=%ld invol_csw=%ld csw_per_task=%.2f\n",
+            modeName(mode), threads, tasks, tasks / sec,
+            after.voluntary - before.voluntary,
+            after.involuntary - before.involuntary,
+            (double)(after.voluntary - before.voluntary + after.involuntary - before.involuntary) / tasks);
+    }
+}
+
+//每个任务的堆分配次数：对比旧的make_shared<packaged_task> + std::function写法
+//和现在的submitTask(池外线程提交、工作窃取模式下池内线程提交)
+static void benchAlloc()
+{
+    const int tasks = 10000;
+
+    {
+        long before = g_allocCount;
+        for(int i = 0; i < tasks; i++)
+        {
+            auto task = std::make_shared<std::packaged_task<int()>>(std::bind([](int x){ return x; }, i));
+            std::future<int> fut = task->get_future();
+            std::function<void()> wrapped([task](){ (*task)(); });
+            wrapped();
+            fut.get();
+        }
+        std::printf("alloc case=shared_packaged_task allocs_per_task=%.2f\n",
+            (double)(g_allocCount - before) / tasks);
+    }
+
+    for(PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_WORKSTEALING})
+    {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(4);
+
+        std::vector<Future<int>> futs;
+        futs.reserve(tasks);
+        auto round = [&]()
+        {
+            futs.clear();
+            for(int i = 0; i < tasks; i++)
+            {
+                futs.emplace_back(pool.submitTask([](int x){ return x; }, i));
+            }
+            for(auto& f : futs) f.get();
+        };
+        //第一轮让内存池和队列长到稳定大小
+        round();
+        long before = g_allocCount;
+        round();
+        std::printf("alloc case=submitTask mode=%s allocs_per_task=%.2f\n",
+            modeName(mode), (double)(g_allocCount - before) / tasks);
+    }
+
+    {
+        //池内线程提交到自己的本地队列
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_WORKSTEALING);
+        pool.start(4);
+        auto nested = [&pool]()
+        {
+            std::vector<Future<int>> futs;
+            futs.reserve(tasks);
+            for(int i = 0; i < tasks; i++)
+            {
+                futs.emplace_back(pool.submitTask([](int x){ return x; }, i));
+            }
+            for(auto& f : futs) f.get();
+        };
+        pool.submitTask(nested).get();
+        long before = g_allocCount;
+        pool.submitTask(nested).get();
+        //减去futs.reserve的一次分配
+        std::printf("alloc case=nested_submitTask mode=workstealing allocs_per_task=%.2f\n",
+            (double)(g_allocCount - before - 1) / tasks);
+    }
+}
+
+//执行fn若干次取最快的一次，单位毫秒
+template<typename F>
+static double bestMs(int reps, F&& fn)
+{
+    double best = 1e300;
+    for(int r = 0; r < reps; r++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+    }
+    return best;
+}
+
+static void printParallel(const char* algo, PoolMode mode, int threads, size_t n, double serialMs, double parallelMs)
+{
+    std::printf("parallel algo=%s mode=%s threads=%d n=%zu serial_ms=%.2f parallel_ms=%.2f speedup=%.2f\n",
+        algo, modeName(mode), threads, n, serialMs, parallelMs, serialMs / parallelMs);
+}
+
+//并行算法和串行循环对比，线程数取硬件线程数
+static void benchParallel()
+{
+    const size_t n = 1 << 22;
+    const int reps = 3;
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<double> in(n), out(n);
+    for(size_t i = 0; i < n; i++) in[i] = (double)i;
+    std::vector<int> unsorted(n);
+    std::mt19937 rng(42);
+    for(int& x : unsorted) x = (int)rng();
+    std::vector<long> scanIn(n), scanOut(n);
+    for(size_t i = 0; i < n; i++) scanIn[i] = (long)(i % 7);
+
+    auto work = [](double x){ return std::sqrt(x) * std::sin(x); };
+
+    for(PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_WORKSTEALING})
+    {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(threads);
+
+        double serial = bestMs(reps, [&](){ for(size_t i = 0; i < n; i++) out[i] = work(in[i]); });
+        double par = bestMs(reps, [&](){ parallel_for(pool, 0, n, [&](size_t i){ out[i] = work(in[i]); }); });
+        printParallel("for", mode, threads, n, serial, par);
+
+        volatile double sink = 0;
+        serial = bestMs(reps, [&](){ double s = 0; for(size_t i = 0; i < n; i++) s += work(in[i]); sink = s; });
+        par = bestMs(reps, [&](){ sink = parallel_reduce(pool, 0, n, 0, 0.0,
+            [&](size_t i){ return work(in[i]); }, std::plus<double>()); });
+        printParallel("reduce", mode, threads, n, serial, par);
+
+        serial = bestMs(reps, [&](){ std::transform(in.begin(), in.end(), out.begin(), work); });
+        par = bestMs(reps, [&](){ parallel_transform(pool, in.begin(), in.end(), out.begin(), work); });
+        printParallel("transform", mode, threads, n, serial, par);
+
+        std::vector<int> v;
+        serial = bestMs(reps, [&](){ v = unsorted; std::sort(v.begin(), v.end()); });
+        par = bestMs(reps, [&](){ v = unsorted; parallel_sort(pool, v.begin(), v.end()); });
+        printParallel("sort", mode, threads, n, serial, par);
+
+        serial = bestMs(reps, [&](){ std::partial_sum(scanIn.begin(), scanIn.end(), scanOut.begin()); });
+        par = bestMs(reps, [&](){ parallel_inclusive_scan(pool, scanIn.begin(), scanIn.end(), scanOut.begin()); });
+        printParallel("inclusive_scan", mode, threads, n, serial, par);
+        (void)sink;
+    }
+}
+
+//忙等一段时间，模拟占用CPU的任务
+static void spinFor(std::chrono::microseconds dur)
+{
+    auto end = std::chrono::steady_clock::now() + dur;
+    while(std::chrono::steady_clock::now() < end) {}
+}
+
+static double percentile(std::vector<double>& v, double p)
+{
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+//低优先级车道被大量批量任务占满时，高优先级小任务从提交到开始执行的延迟
+//对比所有任务都走同一个FIFO车道的情况
+static void benchPriority()
+{
+    const int bulk = 4000;
+    const int probes = 200;
+    const auto bulkWork = std::chrono::microseconds(100);
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+
+    for(bool lanes : {false, true})
+    {
+        ThreadPool pool;
+        pool.start(threads);
+
+        std::vector<Future<void>> bulkFuts;
+        bulkFuts.reserve(bulk);
+        for(int i = 0; i < bulk; i++)
+        {
+            auto fn = [bulkWork](){ spinFor(bulkWork); };
+            bulkFuts.emplace_back(lanes ? pool.submitTask(TaskPriority::PRIORITY_LOW, fn) : pool.submitTask(fn));
+        }
+
+        std::vector<Future<double>> probeFuts;
+        for(int i = 0; i < probes; i++)
+        {
+            auto submitted = std::chrono::steady_clock::now();
+            auto fn = [submitted]()
+            {
+                return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - submitted).count();
+            };
+            probeFuts.emplace_back(lanes ? pool.submitTask(TaskPriority::PRIORITY_HIGH, fn) : pool.submitTask(fn));
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+
+        std::vector<double> lat;
+        for(auto& f : probeFuts) lat.push_back(f.get());
+        for(auto& f : bulkFuts) f.get();
+        double p50 = percentile(lat, 0.50);
+        double p99 = percentile(lat, 0.99);
+        std::printf("priority lanes=%s threads=%d bulk=%d probes=%d p50_us=%.0f p99_us=%.0f max_us=%.0f\n",
+            lanes ? "high_vs_low" : "fifo", threads, bulk, probes, p50, p99, lat.back());
+    }
+}
+
+//cached模式的弹性伸缩：突发的阻塞型任务(睡眠2ms)，每轮之间停一段时间
+//统计每轮完成时间、线程数峰值，最后空闲一段时间后剩下的线程数
+static void benchElastic()
+{
+    const int bursts = 10;
+    const int burst = 200;
+    ThreadPool pool;
+    pool.setMode(PoolMode::MODE_CACHED);
+    pool.start(2);
+
+    std::vector<double> burstMs;
+    int peak = 0;
+    for(int b = 0; b < bursts; b++)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<Future<void>> futs;
+        futs.reserve(burst);
+        for(int i = 0; i < burst; i++)
+        {
+            futs.emplace_back(pool.submitTask([](){ std::this_thread::sleep_for(std::chrono::milliseconds(2)); }));
+        }
+        for(auto& f : futs)
+        {
+            f.get();
+            peak = std::max(peak, pool.threadCount());
+        }
+        burstMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    double first = burstMs.front();
+    double p50 = percentile(burstMs, 0.5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    PoolStats stats = pool.stats();
+    std::printf("elastic bursts=%d burst=%d first_burst_ms=%.1f p50_burst_ms=%.1f peak_threads=%d threads_after_idle=%d created=%llu reclaimed=%llu\n",
+        bursts, burst, first, p50, peak, stats.threads,
+        (unsigned long long)stats.threadsCreated, (unsigned long long)stats.threadsReclaimed);
+}
+
+//固定模式下一部分任务阻塞(睡眠50ms)时，其余计算任务的完成时间
+//对比阻塞任务直接submitTask和用submitBlocking让线程池补偿线程
+static void benchBlocking()
+{
+    const int ioTasks = 8;
+    const int cpuTasks = 2000;
+    const int threads = 4;
+    for(bool hinted : {false, true})
+    {
+        ThreadPool pool;
+        pool.start(threads);
+        auto io = [](){ std::this_thread::sleep_for(std::chrono::milliseconds(50)); };
+        std::vector<Future<void>> ioFuts;
+        for(int i = 0; i < ioTasks; i++)
+        {
+            ioFuts.emplace_back(hinted ? pool.submitBlocking(io) : pool.submitTask(io));
+        }
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<Future<void>> cpuFuts;
+        cpuFuts.reserve(cpuTasks);
+        for(int i = 0; i < cpuTasks; i++)
+        {
+            cpuFuts.emplace_back(pool.submitTask([](){ spinFor(std::chrono::microseconds(20)); }));
+        }
+        for(auto& f : cpuFuts) f.get();
+        double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        int peak = pool.threadCount();
+        for(auto& f : ioFuts) f.get();
+        std::printf("blocking hint=%s threads=%d io_tasks=%d cpu_tasks=%d cpu_done_ms=%.1f threads_during=%d\n",
+            hinted ? "submitBlocking" : "none", threads, ioTasks, cpuTasks, cpuMs, peak);
+    }
+}
+
+//递归分治：任务里提交子任务再get()等待结果，池内线程等待时帮忙执行任务，固定线程数也不会死锁
+//统计各模式的耗时、创建的线程数(嵌套太深时补充的线程)
+static ThreadPool* forkJoinPool = nullptr;
+
+static long forkJoinFib(int n)
+{
+    if(n < 16)
+    {
+        return n < 2 ? n : forkJoinFib(n - 1) + forkJoinFib(n - 2);
+    }
+    Future<long> left = forkJoinPool->submitTask(forkJoinFib, n - 1);
+    long right = forkJoinFib(n - 2);
+    return left.get() + right;
+}
+
+static void benchForkJoin()
+{
+    const int n = 32;
+    const int threads = 4;
+    for(PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED, PoolMode::MODE_WORKSTEALING})
+    {
+        ThreadPool pool;
+        pool.setMode(mode);
+        pool.start(threads);
+        forkJoinPool = &pool;
+        auto begin = std::chrono::steady_clock::now();
+        long result = pool.submitTask(forkJoinFib, n).get();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        PoolStats s = pool.stats();
+        std::printf("forkjoin mode=%s fib(%d)=%ld ms=%.1f tasks=%llu threads_created=%llu\n",
+            modeName(mode), n, result, ms, (unsigned long long)s.tasksExecuted, (unsigned long long)s.threadsCreated);
+        forkJoinPool = nullptr;
+    }
+}
+
+#ifdef __cpp_impl_coroutine
+//模拟异步I/O：after(dur)返回的future在dur之后由一个I/O线程完成，future的executor是线程池
+class SimulatedIo
+{
+public:
+    explicit SimulatedIo(ThreadPool& pool)
+        :pool_(pool)
+        ,stop_(false)
+        ,thread_([this](){ run(); })
+    {}
+
+    ~SimulatedIo()
+    {
+        stop_ = true;
+        thread_.join();
+    }
+
+    Future<void> after(std::chrono::microseconds dur)
+    {
+        Promise<void> promise(pool_.memoryPool(), &pool_);
+        Future<void> future = promise.getFuture();
+        std::lock_guard<std::mutex> lock(mtx_);
+        pending_.emplace_back(std::chrono::steady_clock::now() + dur, std::move(promise));
+        return future;
+    }
+
+private:
+    void run()
+    {
+        while(!stop_)
+        {
+            std::vector<Promise<void>> due;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                auto now = std::chrono::steady_clock::now();
+                for(size_t i = 0; i < pending_.size(); )
+                {
+                    if(pending_[i].first <= now)
+                    {
+                        due.push_back(std::move(pending_[i].second));
+                        pending_[i] = std::move(pending_.back());
+                        pending_.pop_back();
+                    }
+                    else
+                    {
+                        i++;
+                    }
+                }
+            }
+            for(auto& p : due) p.setValue();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    ThreadPool& pool_;
+    std::atomic<bool> stop_;
+    std::mutex mtx_;
+    std::vector<std::pair<std::chrono::steady_clock::time_point, Promise<void>>> pending_;
+    std::thread thread_;
+};
+
+static CoTask<void> coroutineRequest(ThreadPool& pool, SimulatedIo& io, int rounds)
+{
+    co_await pool.schedule();
+    for(int i = 0; i < rounds; i++)
+    {
+        spinFor(std::chrono::microseconds(5));
+        co_await io.after(std::chrono::milliseconds(1));
+    }
+}
+
+//几千个同时进行的逻辑请求，每个请求若干轮"计算5us + 等待I/O 1ms"
+//对比cached模式下每个请求占一个线程阻塞等待，和固定线程数的协程挂起等待
+static void benchCoroutine()
+{
+    const int requests = 5000;
+    const int rounds = 10;
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_CACHED);
+        pool.start(threads);
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<Future<void>> futs;
+        futs.reserve(requests);
+        for(int r = 0; r < requests; r++)
+        {
+            futs.emplace_back(pool.submitTask([rounds]()
+            {
+                for(int i = 0; i < rounds; i++)
+                {
+                    spinFor(std::chrono::microseconds(5));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }));
+        }
+        for(auto& f : futs) f.get();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::printf("coroutine style=blocking_cached requests=%d ms=%.1f threads_created=%llu\n",
+            requests, ms, (unsigned long long)pool.stats().threadsCreated);
+    }
+    {
+        ThreadPool pool;
+        pool.start(threads);
+        SimulatedIo io(pool);
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<Future<void>> futs;
+        futs.reserve(requests);
+        for(int r = 0; r < requests; r++)
+        {
+            futs.emplace_back(co_spawn(coroutineRequest(pool, io, rounds)));
+        }
+        for(auto& f : futs) f.get();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::printf("coroutine style=co_await_fixed requests=%d ms=%.1f threads_created=%llu\n",
+            requests, ms, (unsigned long long)pool.stats().threadsCreated);
+    }
+}
+#endif
+
+//定时器：时间轮上插入/取消100万个定时器的单次耗时，对比std::multimap(红黑树)
+//以及经过线程池的定时任务实际触发时间比要求晚多少
+static void benchTimers()
+{
+    const int count = 1000000;
+    std::mt19937 rng(7);
+    std::vector<std::chrono::milliseconds> delays(count);
+    for(auto& d : delays) d = std::chrono::milliseconds(1000 + rng() % 3600000);
+    auto base = std::chrono::steady_clock::now();
+    {
+        TimerWheel wheel;
+        std::vector<uint64_t> ids(count);
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; i++) ids[i] = wheel.add(base + delays[i], TaskFunc([](){}));
+        double insertNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+        begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; i++) wheel.cancel(ids[i]);
+        double cancelNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+        std::printf("timers impl=wheel count=%d insert_ns=%.1f cancel_ns=%.1f\n", count, insertNs, cancelNs);
+    }
+    {
+        std::multimap<std::chrono::steady_clock::time_point, TaskFunc> tree;
+        std::vector<std::multimap<std::chrono::steady_clock::time_point, TaskFunc>::iterator> its(count);
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; i++) its[i] = tree.emplace(base + delays[i], TaskFunc([](){}));
+        double insertNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+        begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; i++) tree.erase(its[i]);
+        double cancelNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / count;
+        std::printf("timers impl=multimap count=%d insert_ns=%.1f cancel_ns=%.1f\n", count, insertNs, cancelNs);
+    }
+    {
+        const int fired = 10000;
+        ThreadPool pool;
+        pool.start((int)std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<ScheduledFuture<int64_t>> futs;
+        futs.reserve(fired);
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < fired; i++)
+        {
+            auto due = begin + std::chrono::milliseconds(5 + rng() % 200);
+            futs.push_back(pool.submitAt(due, [due]()
+            {
+                return (int64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - due).count();
+            }));
+        }
+        std::vector<int64_t> late;
+        for(auto& f : futs) late.push_back(f.get());
+        std::sort(late.begin(), late.end());
+        std::printf("timers impl=pool fired=%d late_us_min=%lld p50=%lld p99=%lld\n", fired,
+            (long long)late.front(), (long long)late[late.size() / 2], (long long)late[late.size() * 99 / 100]);
+    }
+}
+
+//模拟客户端断开：一个请求提交一批100us的任务，前10%完成后放弃结果
+//不取消时剩下的任务照样跑完，取消后排队中的任务直接跳过；另外对比带token提交空任务的额外开销
+static void benchCancel()
+{
+    const int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    const int count = 20000;
+    for(int cancel = 0; cancel < 2; cancel++)
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_FIXED);
+        pool.start(threads);
+        std::atomic<int> executed(0);
+        CancellationSource source;
+        std::vector<Future<int>> futs;
+        futs.reserve(count);
+        auto begin = std::chrono::steady_clock::now();
+        for(int i = 0; i < count; i++)
+        {
+            futs.push_back(pool.submitTask(source.token(), [&executed]()
+            {
+                spinFor(std::chrono::microseconds(100));
+                executed++;
+                return 0;
+            }));
+        }
+        for(int i = 0; i < count / 10; i++) futs[i].wait();
+        if(cancel) source.cancel();
+        int cancelled = 0;
+        for(auto& f : futs)
+        {
+            try { f.get(); } catch(const TaskCancelledError&) { cancelled++; }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::printf("cancel mode=%s threads=%d tasks=%d executed=%d cancelled=%d ms=%.1f\n",
+            cancel ? "cancel" : "none", threads, count, executed.load(), cancelled, ms);
+    }
+    {
+        const int empty = 1000000;
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_FIXED);
+        pool.start(threads);
+        CancellationSource source;
+        for(int withToken = 0; withToken < 2; withToken++)
+        {
+            double ms = bestMs(3, [&]()
+            {
+                std::vector<Future<int>> futs;
+                futs.reserve(empty);
+                for(int i = 0; i < empty; i++)
+                {
+                    futs.push_back(withToken ? pool.submitTask(source.token(), [](){ return 0; })
+                                             : pool.submitTask([](){ return 0; }));
+                }
+                for(auto& f : futs) f.get();
+            });
+            std::printf("cancel submit=%s tasks=%d ns_per_task=%.1f\n",
+                withToken ? "token" : "plain", empty, ms * 1e6 / empty);
+        }
+    }
+}
+
+//关闭耗时：队列里还有20000个100us的任务时，三种关闭方式从调用到所有线程join的时间
+static void benchShutdown()
+{
+    const int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    const int count = 20000;
+    const char* names[] = {"drain", "cancel", "deadline_10ms"};
+    for(int variant = 0; variant < 3; variant++)
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_FIXED);
+        pool.start(threads);
+        std::vector<Future<void>> futs;
+        futs.reserve(count);
+        for(int i = 0; i < count; i++)
+        {
+            futs.push_back(pool.submitTask([](){ spinFor(std::chrono::microseconds(100)); }));
+        }
+        auto begin = std::chrono::steady_clock::now();
+        if(variant == 0) pool.shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+        else if(variant == 1) pool.shutdown(ShutdownMode::SHUTDOWN_CANCEL);
+        else pool.shutdownFor(std::chrono::milliseconds(10));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        int cancelled = 0;
+        for(auto& f : futs)
+        {
+            try { f.get(); } catch(const TaskCancelledError&) { cancelled++; }
+        }
+        std::printf("shutdown mode=%s threads=%d queued=%d cancelled=%d ms=%.2f\n",
+            names[variant], threads, count, cancelled, ms);
+    }
+}
+
+//任务内临时缓冲区：每个任务分配64个16B..2KB的缓冲区写一遍再释放
+//malloc和ThreadPool::currentArena()对比，1..N个工作线程同时分配
+static void benchArena()
+{
+    const int tasks = 20000;
+    const int buffers = 64;
+    int maxThreads = (int)std::max(4u, std::thread::hardware_concurrency());
+    for(int threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        for(int useArena = 0; useArena < 2; useArena++)
+        {
+            ThreadPool pool;
+            pool.setMode(PoolMode::MODE_FIXED);
+            pool.start(threads);
+            double ms = bestMs(3, [&]()
+            {
+                std::vector<Future<size_t>> futs;
+                futs.reserve(tasks);
+                for(int t = 0; t < tasks; t++)
+                {
+                    futs.push_back(pool.submitTask([useArena](int seed)
+                    {
+                        std::pmr::memory_resource* arena = ThreadPool::currentArena();
+                        void* bufs[buffers];
+                        size_t sizes[buffers];
+                        size_t sum = 0;
+                        for(int i = 0; i < buffers; i++)
+                        {
+                            sizes[i] = 16 + (size_t)((seed * 31 + i * 17) % 2032);
+                            bufs[i] = useArena ? arena->allocate(sizes[i]) : std::malloc(sizes[i]);
+                            std::memset(bufs[i], i, sizes[i]);
+                            sum += static_cast<unsigned char*>(bufs[i])[sizes[i] / 2];
+                        }
+                        for(int i = 0; i < buffers; i++)
+                        {
+                            if(useArena) arena->deallocate(bufs[i], sizes[i]);
+                            else std::free(bufs[i]);
+                        }
+                        return sum;
+                    }, t));
+                }
+                for(auto& f : futs) f.get();
+            });
+            std::printf("arena alloc=%s threads=%d tasks=%d buffers_per_task=%d ms=%.2f ns_per_buffer=%.1f\n",
+                useArena ? "arena" : "malloc", threads, tasks, buffers, ms, ms * 1e6 / ((double)tasks * buffers));
+        }
+    }
+}
+
+//按key保序：每个key的任务要串行修改这个key的数据，对比每个key一把互斥锁和submitKeyed
+//互斥锁的写法里，拿不到锁的工作线程阻塞在锁上；另外对比单个strand和直接submitTask的空任务开销
+static void benchStrand()
+{
+    const int threads = 4;
+    const int keys = 8;
+    const int tasks = 40000;
+    for(int keyed = 0; keyed < 2; keyed++)
+    {
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_FIXED);
+        pool.start(threads);
+        std::vector<std::mutex> locks(keys);
+        std::vector<long> counters(keys, 0);
+        double ms = bestMs(3, [&]()
+        {
+            std::vector<Future<void>> futs;
+            futs.reserve(tasks);
+            for(int i = 0; i < tasks; i++)
+            {
+                int key = i % keys;
+                auto work = [&counters, key]()
+                {
+                    spinFor(std::chrono::microseconds(5));
+                    counters[key]++;
+                };
+                if(keyed)
+                {
+                    futs.push_back(pool.submitKeyed(key, work));
+                }
+                else
+                {
+                    futs.push_back(pool.submitTask([&locks, key, work]()
+                    {
+                        std::lock_guard<std::mutex> lock(locks[key]);
+                        work();
+                    }));
+                }
+            }
+            for(auto& f : futs) f.get();
+        });
+        std::printf("strand impl=%s threads=%d keys=%d tasks=%d ms=%.2f\n",
+            keyed ? "submitKeyed" : "mutex_per_key", threads, keys, tasks, ms);
+    }
+    {
+        const int empty = 1000000;
+        ThreadPool pool;
+        pool.setMode(PoolMode::MODE_FIXED);
+        pool.start(threads);
+        Strand strand(pool);
+        for(int useStrand = 0; useStrand < 2; useStrand++)
+        {
+            double ms = bestMs(3, [&]()
+            {
+                std::vector<Future<int>> futs;
+                futs.reserve(empty);
+                for(int i = 0; i < empty; i++)
+                {
+                    futs.push_back(useStrand ? strand.submitTask([](){ return 0; }) : pool.submitTask([](){ return 0; }));
+                }
+                for(auto& f : futs) f.get();
+            });
+            std::printf("strand submit=%s tasks=%d ns_per_task=%.1f\n",
+                useStrand ? "strand" : "pool", empty, ms * 1e6 / empty);
+        }
+    }
+}
+
+//批量取任务：先把很多个短任务放进队列再开闸，对比每次取一个和每次取一批的吞吐量
+//再放几个长任务在一批里，看其他线程能不能从批里分走剩下的任务
+static void benchBatch()
+{
+    const int tasks = 200000;
+    for(int threads : {1, 4})
+    {
+        for(DequeueMode mode : {DequeueMode::DEQUEUE_SINGLE, DequeueMode::DEQUEUE_BATCH})
+        {
+            ThreadPool pool;
+            pool.setTaskQueMaxThreshHold(tasks + 1);
+            pool.setDequeueMode(mode);
+            pool.start(threads);
+            std::vector<Future<int>> futs;
+            futs.reserve(tasks);
+            double ms = bestMs(3, [&]()
+            {
+                futs.clear();
+                std::atomic<bool> go(false);
+                std::vector<Future<void>> gates;
+                for(int t = 0; t < threads; t++)
+                {
+                    gates.push_back(pool.submitTask([&go](){ while(!go.load()) std::this_thread::yield(); }));
+                }
+                for(int i = 0; i < tasks; i++)
+                {
+                    futs.push_back(pool.submitTask([](int x){ return x + 1; }, i));
+                }
+                go = true;
+                for(auto& f : futs) f.get();
+                for(auto& g : gates) g.get();
+            });
+            std::printf("batch mode=%s threads=%d tasks=%d ms=%.2f ns_per_task=%.1f\n",
+                mode == DequeueMode::DEQUEUE_BATCH ? "batch" : "single", threads, tasks, ms, ms * 1e6 / tasks);
+        }
+    }
+    for(DequeueMode mode : {DequeueMode::DEQUEUE_SINGLE, DequeueMode::DEQUEUE_BATCH})
+    {
+        //3个线程被挡住时第4个线程把长任务整批取走，挡住的线程放开后从它的批里拿走剩下的
+        ThreadPool pool;
+        pool.setDequeueMode(mode);
+        pool.start(4);
+        double ms = bestMs(3, [&]()
+        {
+            std::atomic<bool> go(false);
+            std::vector<Future<void>> gates;
+            for(int t = 0; t < 3; t++)
+            {
+                gates.push_back(pool.submitTask([&go](){ while(!go.load()) std::this_thread::yield(); }));
+            }
+            std::vector<Future<void>> futs;
+            for(int i = 0; i < 64; i++)
+            {
+                futs.push_back(pool.submitTask([](){ spinFor(std::chrono::microseconds(500)); }));
+            }
+            go = true;
+            for(auto& f : futs) f.get();
+            for(auto& g : gates) g.get();
+        });
+        std::printf("batch fairness mode=%s threads=4 tasks=64x500us ms=%.2f\n",
+            mode == DequeueMode::DEQUEUE_BATCH ? "batch" : "single", ms);
+    }
+}
+
+//请求/响应：每次提交一个任务等它返回，两次之间提交者先忙一会儿，队列在这期间是空的
+//对比各种空闲等待方式的往返延迟，以及自旋等到任务和挂起的次数
+static void benchIdle()
+{
+    const int rounds = 5000;
+    const char* names[] = {"block", "spin_park", "busy_poll"};
+    for(int gapUs : {5, 50})
+    {
+        for(IdleStrategy st : {IdleStrategy::IDLE_BLOCK, IdleStrategy::IDLE_SPIN_PARK, IdleStrategy::IDLE_BUSY_POLL})
+        {
+            ThreadPool pool;
+            pool.setIdleStrategy(st);
+            pool.start(1);
+            std::vector<double> lat;
+            lat.reserve(rounds);
+            for(int r = 0; r < rounds; r++)
+            {
+                spinFor(std::chrono::microseconds(gapUs));
+                auto begin = std::chrono::steady_clock::now();
+                pool.submitTask([](){ return 0; }).get();
+                lat.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+            }
+            std::sort(lat.begin(), lat.end());
+            PoolStats ps = pool.stats();
+            std::printf("idle strategy=%s gap_us=%d p50_us=%.2f p99_us=%.2f spin_hits=%llu parks=%llu\n",
+                names[(int)st], gapUs, lat[rounds / 2], lat[rounds * 99 / 100],
+                (unsigned long long)ps.idleSpinHits, (unsigned long long)ps.idleParks);
+        }
+    }
+}
+
+//很多提交线程同时提交空任务，对比一个注入队列和按提交线程分片的提交吞吐量
+static void benchShards()
+{
+    const int perProducer = 50000;
+    for(int producers : {1, 4, 16})
+    {
+        for(int shards : {1, 8})
+        {
+            ThreadPool pool;
+            pool.setInjectionShards(shards);
+            pool.start(4);
+            double ms = bestMs(3, [&]()
+            {
+                std::vector<std::thread> ts;
+                for(int p = 0; p < producers; p++)
+                {
+                    ts.emplace_back([&pool, perProducer]()
+                    {
+                        std::vector<Future<void>> futs;
+                        futs.reserve(perProducer);
+                        for(int i = 0; i < perProducer; i++)
+                        {
+                            futs.push_back(pool.submitTask([](){}));
+                        }
+                        for(auto& f : futs) f.get();
+                    });
+                }
+                for(auto& t : ts) t.join();
+            });
+            long tasks = (long)producers * perProducer;
+            std::printf("shards producers=%d shards=%d tasks=%ld ms=%.2f tasks_per_sec=%.0f\n",
+                producers, shards, tasks, ms, tasks / ms * 1000);
+        }
+    }
+}
+
+//线程池组：io子池2个线程，积压了一批1ms的阻塞任务，cpu子池4个线程空闲
+//对比cpu子池不借出和空闲时借出线程，积压任务全部完成的时间
+static void benchGroup()
+{
+    const int tasks = 200;
+    for(LendPolicy lend : {LendPolicy::LEND_NONE, LendPolicy::LEND_WHEN_IDLE, LendPolicy::LEND_WHEN_SATURATED})
+    {
+        PoolGroup group;
+        SubPoolOptions cpu;
+        cpu.threads = 4;
+        cpu.lend = lend;
+        group.addPool("cpu", cpu);
+        SubPoolOptions io;
+        io.threads = 2;
+        ThreadPool& ioPool = group.addPool("io", io);
+        group.start();
+        double ms = bestMs(3, [&]()
+        {
+            std::vector<Future<void>> futs;
+            for(int i = 0; i < tasks; i++)
+            {
+                futs.push_back(ioPool.submitTask([](){ std::this_thread::sleep_for(std::chrono::milliseconds(1)); }));
+            }
+            for(auto& f : futs) f.get();
+        });
+        const char* name = lend == LendPolicy::LEND_NONE ? "none" : lend == LendPolicy::LEND_WHEN_IDLE ? "when_idle" : "when_saturated";
+        std::printf("group lend=%s io_threads=2 cpu_threads=4 tasks=%dx1ms ms=%.2f borrowed=%llu\n",
+            name, tasks, ms, (unsigned long long)ioPool.stats().tasksBorrowed);
+    }
+}
+
+//基准测试套件的输出格式和参数，在main里从命令行读取
+static const char* g_suiteFormat = "text";
+static int g_suiteMaxThreads = 0;
+static const char* g_suiteLabel = "improved_threadpool";
+
+//套件的一条结果，没有延迟分布的负载分位数为负
+struct SuiteResult
+{
+    const char* workload;
+    long tasks;
+    double seconds;
+    double p50Us = -1;
+    double p99Us = -1;
+    double p999Us = -1;
+};
+
+static double secondsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static double microsSince(std::chrono::steady_clock::time_point begin)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void fillPercentiles(SuiteResult& r, std::vector<double>& lat)
+{
+    if(lat.empty()) return;
+    r.p50Us = percentile(lat, 0.50);
+    r.p99Us = percentile(lat, 0.99);
+    r.p999Us = percentile(lat, 0.999);
+}
+
+//空任务吞吐量：池外线程一次提交一大批空任务再全部等待
+static SuiteResult suiteEmpty(ThreadPool& pool)
+{
+    const int tasks = 100000;
+    std::vector<Future<void>> futs;
+    futs.reserve(tasks);
+    auto begin = std::chrono::steady_clock::now();
+    for(int i = 0; i < tasks; i++)
+    {
+        futs.emplace_back(pool.submitTask([](){}));
+    }
+    for(auto& f : futs) f.get();
+    return SuiteResult{"empty", tasks, secondsSince(begin)};
+}
+
+//从提交到开始执行的延迟：每轮提交和线程数一样多的任务，等它们全部完成再开始下一轮
+static SuiteResult suiteLatency(ThreadPool& pool)
+{
+    const int rounds = 2000;
+    int batch = std::max(1, pool.threadCount());
+    std::vector<double> lat;
+    lat.reserve((size_t)rounds * batch);
+    std::vector<Future<double>> futs;
+    futs.reserve(batch);
+    auto begin = std::chrono::steady_clock::now();
+    for(int r = 0; r < rounds; r++)
+    {
+        futs.clear();
+        for(int i = 0; i < batch; i++)
+        {
+            auto submitted = std::chrono::steady_clock::now();
+            futs.emplace_back(pool.submitTask([submitted](){ return microsSince(submitted); }));
+        }
+        for(auto& f : futs) lat.push_back(f.get());
+    }
+    SuiteResult result{"latency", (long)rounds * batch, secondsSince(begin)};
+    fillPercentiles(result, lat);
+    return result;
+}
+
+//扇出/扇入：每轮提交width个小任务，用when_all(...).then()汇总，分位数是每轮的耗时
+static SuiteResult suiteFanout(ThreadPool& pool)
+{
+    const int rounds = 500;
+    const int width = 64;
+    std::vector<double> lat;
+    lat.reserve(rounds);
+    auto begin = std::chrono::steady_clock::now();
+    for(int r = 0; r < rounds; r++)
+    {
+        auto roundBegin = std::chrono::steady_clock::now();
+        std::vector<Future<int>> futs;
+        futs.reserve(width);
+        for(int i = 0; i < width; i++)
+        {
+            futs.emplace_back(pool.submitTask([](int x){ return x; }, i));
+        }
+        Future<int> sum = when_all(std::move(futs)).then([](std::vector<Future<int>> parts)
+        {
+            int s = 0;
+            for(auto& f : parts) s += f.get();
+            return s;
+        });
+        if(sum.get() != width * (width - 1) / 2) std::abort();
+        lat.push_back(microsSince(roundBegin));
+    }
+    SuiteResult result{"fanout", (long)rounds * (width + 1), secondsSince(begin)};
+    fillPercentiles(result, lat);
+    return result;
+}
+
+//嵌套提交：任务在池内递归提交两个子任务，形成一棵满二叉树，不阻塞等待子任务
+struct NestedTree
+{
+    ThreadPool* pool;
+    std::atomic<long> remaining;
+    Promise<void> done;
+};
+
+static void nestedSpawn(NestedTree* tree, int depth)
+{
+    if(depth > 0)
+    {
+        tree->pool->submitTask(nestedSpawn, tree, depth - 1);
+        tree->pool->submitTask(nestedSpawn, tree, depth - 1);
+    }
+    if(tree->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        tree->done.setValue();
+    }
+}
+
+static SuiteResult suiteNested(ThreadPool& pool)
+{
+    const int depth = 14;
+    NestedTree tree;
+    tree.pool = &pool;
+    tree.remaining = (2L << depth) - 1;
+    Future<void> done = tree.done.getFuture();
+    auto begin = std::chrono::steady_clock::now();
+    pool.submitTask(nestedSpawn, &tree, depth);
+    done.get();
+    return SuiteResult{"nested", (2L << depth) - 1, secondsSince(begin)};
+}
+
+//长短混合：每100个任务里1个忙等2ms，其余忙等5us，分位数是短任务从提交到开始执行的延迟
+static SuiteResult suiteMixed(ThreadPool& pool)
+{
+    const int tasks = 4000;
+    std::vector<Future<double>> futs;
+    futs.reserve(tasks);
+    auto begin = std::chrono::steady_clock::now();
+    for(int i = 0; i < tasks; i++)
+    {
+        auto submitted = std::chrono::steady_clock::now();
+        auto work = std::chrono::microseconds(i % 100 == 0 ? 2000 : 5);
+        futs.emplace_back(pool.submitTask([submitted, work]()
+        {
+            double waited = microsSince(submitted);
+            spinFor(work);
+            return waited;
+        }));
+    }
+    std::vector<double> lat;
+    lat.reserve(tasks);
+    for(int i = 0; i < tasks; i++)
+    {
+        double waited = futs[i].get();
+        if(i % 100 != 0) lat.push_back(waited);
+    }
+    SuiteResult result{"mixed", tasks, secondsSince(begin)};
+    fillPercentiles(result, lat);
+    return result;
+}
+
+static void printSuiteResult(const SuiteResult& r, PoolMode mode, int threads, bool first)
+{
+    double tps = r.tasks / r.seconds;
+    if(std::strcmp(g_suiteFormat, "csv") == 0)
+    {
+        if(first) std::printf("label,workload,mode,threads,tasks,seconds,tasks_per_sec,p50_us,p99_us,p999_us\n");
+        std::printf("%s,%s,%s,%d,%ld,%.6f,%.0f,", g_suiteLabel, r.workload, modeName(mode), threads, r.tasks, r.seconds, tps);
+        if(r.p50Us >= 0) std::printf("%.1f,%.1f,%.1f\n", r.p50Us, r.p99Us, r.p999Us);
+        else std::printf(",,\n");
+    }
+    else if(std::strcmp(g_suiteFormat, "json") == 0)
+    {
+        std::printf("%s{\"label\":\"%s\",\"workload\":\"%s\",\"mode\":\"%s\",\"threads\":%d,\"tasks\":%ld,"
+            "\"seconds\":%.6f,\"tasks_per_sec\":%.0f",
+            first ? "[\n  " : ",\n  ", g_suiteLabel, r.workload, modeName(mode), threads, r.tasks, r.seconds, tps);
+        if(r.p50Us >= 0) std::printf(",\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f", r.p50Us, r.p99Us, r.p999Us);
+        std::printf("}");
+    }
+    else
+    {
+        std::printf("suite workload=%s mode=%s threads=%d tasks=%ld sec=%.3f tasks_per_sec=%.0f",
+            r.workload, modeName(mode), threads, r.tasks, r.seconds, tps);
+        if(r.p50Us >= 0) std::printf(" p50_us=%.1f p99_us=%.1f p999_us=%.1f", r.p50Us, r.p99Us, r.p999Us);
+        std::printf("\n");
+    }
+    std::fflush(stdout);
+}
+
+//负载 x 模式 x 线程数(1, 2, 4, ... 直到最大线程数)，每个组合用一个新的线程池
+static void benchSuite()
+{
+    struct Workload
+    {
+        const char* name;
+        SuiteResult (*run)(ThreadPool&);
+    };
+    const Workload workloads[] = {
+        {"empty", suiteEmpty},
+        {"latency", suiteLatency},
+        {"fanout", suiteFanout},
+        {"nested", suiteNested},
+        {"mixed", suiteMixed},
+    };
+
+    int maxThreads = g_suiteMaxThreads > 0 ? g_suiteMaxThreads : (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for(int t = 1; t < maxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    bool first = true;
+    for(const Workload& w : workloads)
+    {
+        for(PoolMode mode : {PoolMode::MODE_FIXED, PoolMode::MODE_CACHED, PoolMode::MODE_WORKSTEALING})
+        {
+            for(int threads : threadCounts)
+            {
+                ThreadPool pool;
+                pool.setMode(mode);
+                pool.start(threads);
+                //等工作线程都启动并挂起
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                printSuiteResult(w.run(pool), mode, threads, first);
+                first = false;
+            }
+        }
+    }
+    if(std::strcmp(g_suiteFormat, "json") == 0) std::printf("\n]\n");
+}
+
+int main(int argc, char** argv)
+{
+    struct Case
+    {
+        const char* name;
+        void (*run)();
+    };
+    const Case cases[] = {
+        {"wakeup", benchWakeup},
+        {"alloc", benchAlloc},
+        {"parallel", benchParallel},
+        {"priority", benchPriority},
+        {"elastic", benchElastic},
+        {"blocking", benchBlocking},
+        {"forkjoin", benchForkJoin},
+        {"timers", benchTimers},
+        {"cancel", benchCancel},
+        {"shutdown", benchShutdown},
+        {"arena", benchArena},
+        {"strand", benchStrand},
+        {"batch", benchBatch},
+        {"idle", benchIdle},
+        {"shards", benchShards},
+        {"group", benchGroup},
+#ifdef __cpp_impl_coroutine
+        {"coroutine", benchCoroutine},
+#endif
+        {"suite", benchSuite},
+    };
+
+    if(argc > 2) g_suiteFormat = argv[2];
+    if(argc > 3) g_suiteMaxThreads = std::atoi(argv[3]);
+    if(argc > 4) g_suiteLabel = argv[4];
+
+    for(const Case& c : cases)
+    {
+        if(argc > 1 && std::strcmp(argv[1], c.name) != 0) continue;
+        c.run();
+    }
+    return 0;
+}
@@ -0,0 +1,222 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "future.h"
+
+
+//登记的future超过这个数量时先清理已经完成的，长期存在的作用域不会无限增长
+const size_t CANCELLATION_PRUNE_MIN = 64;
+
+
+//一个取消作用域的共享状态，CancellationSource和它发出的CancellationToken共同持有
+//登记在作用域下的任务：取消时还没开始执行的future立即得到TaskCancelledError，正在运行的任务轮询isCancelled()自己停下
+class CancellationState
+{
+public:
+    CancellationState() : cancelled_(false), pruneAt_(CANCELLATION_PRUNE_MIN) {}
+
+    CancellationState(const CancellationState&) = delete;
+    CancellationState& operator=(const CancellationState&) = delete;
+
+    ~CancellationState()
+    {
+        for(FutureStateBase* s : pending_)
+        {
+            s->release();
+        }
+    }
+
+    bool isCancelled() const
+    {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    //取消作用域和所有子作用域，返回false说明之前已经取消过
+    //future的后续任务可能在这里被派发，在锁外进行
+    bool cancel()
+    {
+        std::vector<FutureStateBase*> pending;
+        std::vector<std::weak_ptr<CancellationState>> children;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(cancelled_.exchange(true, std::memory_order_acq_rel)) return false;
+            pending.swap(pending_);
+            children.swap(children_);
+        }
+        for(FutureStateBase* s : pending)
+        {
+            s->tryCancel();
+            s->release();
+        }
+        for(auto& weak : children)
+        {
+            if(auto child = weak.lock()) child->cancel();
+        }
+        return true;
+    }
+
+    //登记一个还没执行的任务的共享状态，作用域已经取消时不登记，返回false
+    bool track(FutureStateBase* s)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(isCancelled()) return false;
+        if(pending_.size() >= pruneAt_)
+        {
+            prune();
+        }
+        s->retain();
+        pending_.push_back(s);
+        return true;
+    }
+
+    //子作用域跟随父作用域取消，父作用域已经取消时返回false
+    bool link(const std::shared_ptr<CancellationState>& child)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(isCancelled()) return false;
+        children_.erase(std::remove_if(children_.begin(), children_.end(),
+            [](const std::weak_ptr<CancellationState>& w){ return w.expired(); }), children_.end());
+        children_.push_back(child);
+        return true;
+    }
+
+private:
+    //去掉已经有结果的状态，下一次清理的阈值翻倍，均摊到每次登记是O(1)
+    void prune()
+    {
+        size_t kept = 0;
+        for(FutureStateBase* s : pending_)
+        {
+            if(s->isReady())
+            {
+                s->release();
+            }
+            else
+            {
+                pending_[kept++] = s;
+            }
+        }
+        pending_.resize(kept);
+        pruneAt_ = std::max(CANCELLATION_PRUNE_MIN, kept * 2);
+    }
+
+    std::atomic<bool> cancelled_;
+    std::mutex mtx_;
+    std::vector<FutureStateBase*> pending_; //登记的任务，各持有一份引用
+    size_t pruneAt_;
+    std::vector<std::weak_ptr<CancellationState>> children_;
+};
+
+
+//只读的取消标志，可以复制，传给任务让它轮询
+//默认构造的token永远不会被取消
+class CancellationToken
+{
+public:
+    CancellationToken() = default;
+
+    bool isCancelled() const
+    {
+        return state_ != nullptr && state_->isCancelled();
+    }
+
+    bool canBeCancelled() const { return state_ != nullptr; }
+
+    //当前线程正在执行的任务提交时带的token，池外线程或者没有带token的任务得到一个不会取消的token
+    //不方便把token一路传下去的代码用它轮询
+    static const CancellationToken& current()
+    {
+        return currentSlot();
+    }
+
+    //线程池内部使用：登记任务的共享状态，token已经取消时返回false
+    bool track(FutureStateBase* s) const
+    {
+        return state_ == nullptr || state_->track(s);
+    }
+
+private:
+    friend class CancellationSource;
+    friend class CancellationScope;
+    explicit CancellationToken(std::shared_ptr<CancellationState> state) : state_(std::move(state)) {}
+
+    static CancellationToken& currentSlot()
+    {
+        static thread_local CancellationToken token;
+        return token;
+    }
+
+    std::shared_ptr<CancellationState> state_;
+};
+
+
+//取消作用域：同一个source发出的token提交的任务是一组，cancel()一次取消整组
+//用父作用域的token构造时成为子作用域，父作用域取消时跟着取消
+class CancellationSource
+{
+public:
+    CancellationSource()
+        :state_(std::make_shared<CancellationState>())
+    {}
+
+    explicit CancellationSource(const CancellationToken& parent)
+        :state_(std::make_shared<CancellationState>())
+    {
+        if(parent.state_ != nullptr && !parent.state_->link(state_))
+        {
+            state_->cancel();
+        }
+    }
+
+    CancellationToken token() const
+    {
+        return CancellationToken(state_);
+    }
+
+    bool cancel()
+    {
+        return state_->cancel();
+    }
+
+    bool isCancelled() const
+    {
+        return state_->isCancelled();
+    }
+
+private:
+    std::shared_ptr<CancellationState> state_;
+};
+
+
+//任务执行期间把CancellationToken::current()设置为它的token，结束后恢复(帮忙执行的任务会嵌套)
+class CancellationScope
+{
+public:
+    explicit CancellationScope(const CancellationToken& token)
+        :saved_(std::move(CancellationToken::currentSlot()))
+    {
+        CancellationToken::currentSlot() = token;
+    }
+
+    ~CancellationScope()
+    {
+        CancellationToken::currentSlot() = std::move(saved_);
+    }
+
+    CancellationScope(const CancellationScope&) = delete;
+    CancellationScope& operator=(const CancellationScope&) = delete;
+
+private:
+    CancellationToken saved_;
+};
+
+
+#endif
@@ -0,0 +1,339 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <new>
+#include <type_traits>
+#include <cstddef>
+
+#include "improved_threadpool.h"
+
+
+/*
+ C++20协程和线程池的结合，需要-std=c++20
+ - CoTask<T>：惰性启动的协程，被co_await时才开始执行，co_await它时挂起等待而不是阻塞线程
+ - co_await pool.schedule()：切换到线程池的工作线程上继续执行
+ - co_await future：线程池返回的Future<T>完成后，协程在线程池上恢复(由future的executor派发)
+ - co_spawn(task)：启动一个CoTask，返回它结果的Future；sync_wait(task)：在普通线程(比如main)里阻塞等待结果
+ 挂起的协程只占用协程帧，不占用线程，几千个同时在等待的逻辑任务也只需要几个工作线程
+*/
+
+
+//协程帧前面放分配它的内存池指针，保持16字节对齐
+const size_t COROUTINE_FRAME_HEADER = 16;
+
+//协程帧的分配：第一个参数是ThreadPool&的协程从这个线程池的内存池分配，
+//其他协程在工作线程上创建时用所属线程池的内存池，池外线程用全局内存池
+//帧不超过1KB时走内存池的空闲链表，更大的直接new
+class CoroutineFrameAllocator
+{
+public:
+    static void* operator new(size_t size)
+    {
+        ThreadPool* pool = ThreadPool::current();
+        return allocateFrame(pool != nullptr ? pool->memoryPool() : StatePool::global(), size);
+    }
+
+    template<typename... Args>
+    static void* operator new(size_t size, ThreadPool& pool, Args&&...)
+    {
+        return allocateFrame(pool.memoryPool(), size);
+    }
+
+    static void operator delete(void* frame, size_t size)
+    {
+        char* block = static_cast<char*>(frame) - COROUTINE_FRAME_HEADER;
+        StatePool* pool = *reinterpret_cast<StatePool**>(block);
+        pool->deallocate(block, size + COROUTINE_FRAME_HEADER, COROUTINE_FRAME_HEADER);
+    }
+
+private:
+    //内存池的每个块各持有一份内存池的引用，线程池先析构时还没释放的帧也是安全的
+    static void* allocateFrame(StatePool* pool, size_t size)
+    {
+        char* block = static_cast<char*>(pool->allocate(size + COROUTINE_FRAME_HEADER, COROUTINE_FRAME_HEADER));
+        *reinterpret_cast<StatePool**>(block) = pool;
+        return block + COROUTINE_FRAME_HEADER;
+    }
+};
+
+
+template<typename T> class CoTask;
+
+//CoTask的promise中与返回值无关的部分
+//结束时对称转移到co_await它的协程，不经过线程池，也不会递归加深调用栈
+class CoTaskPromiseBase : public CoroutineFrameAllocator
+{
+public:
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> cont = handle.promise().continuation_;
+            return cont ? cont : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() noexcept
+    {
+        error_ = std::current_exception();
+    }
+
+    void setContinuation(std::coroutine_handle<> cont) noexcept
+    {
+        continuation_ = cont;
+    }
+
+protected:
+    void rethrowIfError()
+    {
+        if(error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    std::coroutine_handle<> continuation_; //co_await这个任务的协程
+    std::exception_ptr error_;
+};
+
+template<typename T>
+class CoTaskPromise : public CoTaskPromiseBase
+{
+public:
+    CoTaskPromise() = default;
+    CoTaskPromise(const CoTaskPromise&) = delete;
+
+    ~CoTaskPromise()
+    {
+        if(hasValue_)
+        {
+            value().~T();
+        }
+    }
+
+    template<typename U>
+    void return_value(U&& v)
+    {
+        new (storage_) T(std::forward<U>(v));
+        hasValue_ = true;
+    }
+
+    T result()
+    {
+        rethrowIfError();
+        return std::move(value());
+    }
+
+private:
+    T& value() { return *std::launder(reinterpret_cast<T*>(storage_)); }
+
+    alignas(T) unsigned char storage_[sizeof(T)];
+    bool hasValue_ = false;
+};
+
+template<>
+class CoTaskPromise<void> : public CoTaskPromiseBase
+{
+public:
+    void return_void() noexcept {}
+
+    void result()
+    {
+        rethrowIfError();
+    }
+};
+
+
+//惰性启动的协程任务，只能移动；co_await它启动执行，完成后在完成它的线程上恢复等待者
+//结果只能取一次，T不支持引用类型
+template<typename T = void>
+class CoTask
+{
+public:
+    struct promise_type : CoTaskPromise<T>
+    {
+        CoTask get_return_object() noexcept
+        {
+            return CoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    class Awaiter
+    {
+    public:
+        explicit Awaiter(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+        bool await_ready() const noexcept
+        {
+            return !handle_ || handle_.done();
+        }
+
+        //记下等待者，直接转到被等待的协程执行
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle_.promise().setContinuation(awaiting);
+            return handle_;
+        }
+
+        T await_resume()
+        {
+            if(!handle_)
+            {
+                throw std::future_error(std::future_errc::no_state);
+            }
+            return handle_.promise().result();
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    CoTask() noexcept : handle_(nullptr) {}
+
+    CoTask(CoTask&& other) noexcept
+        :handle_(other.handle_)
+    {
+        other.handle_ = nullptr;
+    }
+
+    CoTask& operator=(CoTask&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(handle_) handle_.destroy();
+            handle_ = other.handle_;
+            other.handle_ = nullptr;
+        }
+        return *this;
+    }
+
+    CoTask(const CoTask&) = delete;
+    CoTask& operator=(const CoTask&) = delete;
+
+    //没有启动或已经结束的协程可以直接销毁；被co_await期间CoTask必须活着
+    ~CoTask()
+    {
+        if(handle_) handle_.destroy();
+    }
+
+    bool valid() const noexcept { return static_cast<bool>(handle_); }
+
+    Awaiter operator co_await() const noexcept
+    {
+        return Awaiter(handle_);
+    }
+
+private:
+    explicit CoTask(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+
+//co_await future：没有完成时挂上后续任务，完成后由future的executor(线程池)恢复协程，池外的future在完成它的线程里恢复
+//和then()一样每个future只能挂一个后续，等待后future失效
+template<typename T>
+class FutureAwaiter
+{
+public:
+    explicit FutureAwaiter(Future<T>& future) : future_(future) {}
+
+    bool await_ready() const
+    {
+        return future_.isReady();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        FutureAccess::state(future_)->setContinuation([handle]() mutable { handle.resume(); }, false);
+    }
+
+    T await_resume()
+    {
+        return future_.get();
+    }
+
+private:
+    Future<T>& future_;
+};
+
+template<typename T>
+FutureAwaiter<T> operator co_await(Future<T>& future)
+{
+    return FutureAwaiter<T>(future);
+}
+
+//co_await pool.submitTask(...)：临时的future在整个co_await表达式期间都活着
+template<typename T>
+FutureAwaiter<T> operator co_await(Future<T>&& future)
+{
+    return FutureAwaiter<T>(future);
+}
+
+
+//立即开始、结束后自己销毁的协程，只用来驱动co_spawn
+struct CoDetached
+{
+    struct promise_type : CoroutineFrameAllocator
+    {
+        CoDetached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+template<typename T>
+CoDetached coRunInto(CoTask<T> task, Promise<T> promise)
+{
+    try
+    {
+        if constexpr(std::is_void<T>::value)
+        {
+            co_await task;
+            promise.setValue();
+        }
+        else
+        {
+            promise.setValue(co_await task);
+        }
+    }
+    catch(...)
+    {
+        promise.setException(std::current_exception());
+    }
+}
+
+//在当前线程启动task，运行到第一个挂起点返回，结果(或异常)放进返回的future
+//要让协程从一开始就在线程池上运行，在协程开头co_await pool.schedule()
+template<typename T>
+Future<T> co_spawn(CoTask<T> task)
+{
+    Promise<T> promise;
+    Future<T> future = promise.getFuture();
+    coRunInto(std::move(task), std::move(promise));
+    return future;
+}
+
+//在普通线程里阻塞等待协程的结果，在工作线程上调用时等待期间会帮线程池执行任务
+template<typename T>
+T sync_wait(CoTask<T> task)
+{
+    return co_spawn(std::move(task)).get();
+}
+
+
+#endif
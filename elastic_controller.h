@@ -0,0 +1,135 @@
+#ifndef ELASTIC_CONTROLLER_H
+#define ELASTIC_CONTROLLER_H
+
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+
+const int ELASTIC_SAMPLE_MS = 50; //弹性控制器的默认采样间隔
+const int ELASTIC_WAIT_TARGET_US = 1000; //排队等待的p90超过它认为线程不够
+const int ELASTIC_SPAWN_INTERVAL_US = 1000; //两次创建线程之间的最小间隔
+const int ELASTIC_IDLE_TIMEOUT_MS = 1000; //一直有空闲线程超过这么久开始缩容
+const int ELASTIC_MAX_STEP = 8; //持续饥饿时每次采样最多增加的线程数
+const double HILL_CLIMB_NOISE = 0.05; //吞吐量变化小于5%当作噪声
+
+
+//MODE_CACHED的弹性伸缩参数，线程数量为0的项使用start()的线程数和setThreadSizeThreshHold()的上限
+struct ElasticOptions
+{
+    int minThreads = 0;
+    int maxThreads = 0;
+    std::chrono::milliseconds sampleInterval{ELASTIC_SAMPLE_MS};
+    std::chrono::microseconds queueWaitTarget{ELASTIC_WAIT_TARGET_US};
+    std::chrono::microseconds spawnInterval{ELASTIC_SPAWN_INTERVAL_US};
+    std::chrono::milliseconds idleTimeout{ELASTIC_IDLE_TIMEOUT_MS};
+};
+
+//一次采样的测量值
+struct ElasticSample
+{
+    double seconds; //距离上一次采样的时间
+    uint64_t completed; //这段时间完成的任务数
+    int queued; //采样时排队的任务数
+    int threads;
+    int idle;
+    std::chrono::nanoseconds queueWaitP90; //这段时间开始执行的任务的排队时间p90
+};
+
+
+/*
+ 爬山法线程数量控制器，思路来自.NET线程池的hill-climbing注入器，只做决策不管线程
+ - 排队等待超过目标：线程不够，增加目标线程数，连续饥饿时步长翻倍
+ - 有空闲线程且队列为空持续idleTimeout：按空闲数量的一半缩小目标
+ - 线程都在忙且等待没有超标：比较这一次和上一次的吞吐量，上一步有改善就沿同方向再走一步，变差就退回
+   阻塞型任务多时加线程能提高吞吐量，纯计算任务加线程只会增加切换，吞吐量不升反降时会退回
+*/
+class ElasticController
+{
+public:
+    //initial是启动时的线程数，限制在[minThreads, maxThreads]内
+    ElasticController(int minThreads, int maxThreads, int initial, const ElasticOptions& options)
+        :min_(std::max(1, minThreads))
+        ,max_(std::max(std::max(1, minThreads), maxThreads))
+        ,target_(std::min(max_, std::max(min_, initial)))
+        ,options_(options)
+        ,lastStep_(0)
+        ,starveStep_(1)
+        ,idleTime_(0)
+        ,lastThroughput_(0)
+    {}
+
+    int target() const { return target_; }
+
+    //根据一次采样更新并返回目标线程数
+    int update(const ElasticSample& s)
+    {
+        double throughput = s.seconds > 0 ? s.completed / s.seconds : 0;
+        bool starving = s.queued > 0 && s.queueWaitP90 > options_.queueWaitTarget;
+
+        if(starving)
+        {
+            idleTime_ = 0;
+            step(starveStep_);
+            starveStep_ = std::min(starveStep_ * 2, ELASTIC_MAX_STEP);
+        }
+        else if(s.idle > 0 && s.queued == 0)
+        {
+            starveStep_ = 1;
+            lastStep_ = 0;
+            idleTime_ += s.seconds;
+            if(idleTime_ >= std::chrono::duration<double>(options_.idleTimeout).count())
+            {
+                idleTime_ = 0;
+                step(-std::max(1, s.idle / 2));
+            }
+        }
+        else
+        {
+            starveStep_ = 1;
+            idleTime_ = 0;
+            if(lastStep_ != 0 && throughput < lastThroughput_ * (1 - HILL_CLIMB_NOISE))
+            {
+                step(-lastStep_);
+                lastStep_ = 0; //退回后停在这里，等下一次有排队再试探
+            }
+            else if(lastStep_ != 0 && throughput > lastThroughput_ * (1 + HILL_CLIMB_NOISE))
+            {
+                step(lastStep_ > 0 ? 1 : -1);
+            }
+            else if(lastStep_ == 0 && s.queued > 0)
+            {
+                //线程全忙还有排队但等待没超标，试探着加一个
+                step(1);
+            }
+            else
+            {
+                lastStep_ = 0;
+            }
+        }
+        lastThroughput_ = throughput;
+        return target_;
+    }
+
+private:
+    void step(int delta)
+    {
+        int next = std::min(max_, std::max(min_, target_ + delta));
+        lastStep_ = next - target_;
+        target_ = next;
+    }
+
+private:
+    int min_;
+    int max_;
+    int target_;
+    ElasticOptions options_;
+    int lastStep_; //上一次采样对目标的调整
+    int starveStep_; //饥饿时下一次增加的步长
+    double idleTime_; //连续有空闲线程的时间，秒
+    double lastThroughput_;
+};
+
+
+#endif
@@ -0,0 +1,1241 @@
+#ifndef FUTURE_H
+#define FUTURE_H
+
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <future>
+#include <chrono>
+#include <new>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <memory>
+#include <tuple>
+#include <thread>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+
+//任务在执行前被取消时，它的future得到这个异常
+class TaskCancelledError : public std::runtime_error
+{
+public:
+    TaskCancelledError() : std::runtime_error("task cancelled") {}
+};
+
+
+//共享状态的内存池，协程帧也从这里分配(见coroutine.h)
+//按64/128/256/512/1024字节分级，每级一个空闲链表，用完的块放回链表复用，稳定运行后提交任务不再走malloc
+//分配在互斥锁下从本地链表取；释放可能发生在任意线程，无锁压入freed链表，本地链表空了再整体换过来
+//引用计数：创建者持有一份，每个未归还的块持有一份，最后一个释放时析构
+class StatePool
+{
+public:
+    static StatePool* create()
+    {
+        return new StatePool();
+    }
+
+    //不属于任何线程池的Promise使用的全局内存池，进程结束前不释放
+    static StatePool* global()
+    {
+        static StatePool* pool = create();
+        return pool;
+    }
+
+    void retain()
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if(refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
+    void* allocate(size_t size, size_t align)
+    {
+        int cls = sizeClass(size, align);
+        if(cls < 0)
+        {
+            return ::operator new(size, std::align_val_t(align));
+        }
+
+        retain();
+        Bucket& b = buckets_[cls];
+        std::lock_guard<std::mutex> lock(b.mtx);
+        if(b.local == nullptr)
+        {
+            b.local = b.freed.exchange(nullptr, std::memory_order_acquire);
+        }
+        if(b.local == nullptr)
+        {
+            grow(b, CLASS_SIZES[cls]);
+        }
+        Block* blk = b.local;
+        b.local = blk->next;
+        return blk;
+    }
+
+    void deallocate(void* p, size_t size, size_t align)
+    {
+        int cls = sizeClass(size, align);
+        if(cls < 0)
+        {
+            ::operator delete(p, std::align_val_t(align));
+            return;
+        }
+
+        Bucket& b = buckets_[cls];
+        Block* blk = static_cast<Block*>(p);
+        blk->next = b.freed.load(std::memory_order_relaxed);
+        while(!b.freed.compare_exchange_weak(blk->next, blk,
+            std::memory_order_release, std::memory_order_relaxed))
+        {}
+        release();
+    }
+
+    //预先为共享状态用到的每个大小等级准备至少count个块
+    //块由调用线程第一次写入，在Linux的首次访问策略下内存页落在调用线程所在的NUMA节点上
+    void prefault(size_t count)
+    {
+        for(int cls = 0; cls < STATE_CLASS_COUNT; cls++)
+        {
+            Bucket& b = buckets_[cls];
+            std::lock_guard<std::mutex> lock(b.mtx);
+            while(b.chunks.size() * BLOCKS_PER_CHUNK < count)
+            {
+                grow(b, CLASS_SIZES[cls]);
+            }
+        }
+    }
+
+    StatePool(const StatePool&) = delete;
+    StatePool& operator=(const StatePool&) = delete;
+
+private:
+    StatePool():refs_(1) {}
+
+    ~StatePool()
+    {
+        for(Bucket& b : buckets_)
+        {
+            for(void* chunk : b.chunks)
+            {
+                ::operator delete(chunk, std::align_val_t(BLOCK_ALIGN));
+            }
+        }
+    }
+
+    struct Block
+    {
+        Block* next;
+    };
+
+    struct alignas(64) Bucket
+    {
+        std::mutex mtx;
+        Block* local = nullptr; //只在mtx下访问
+        std::atomic<Block*> freed{nullptr}; //其他线程归还的块
+        std::vector<void*> chunks; //整块申请的内存，析构时释放
+    };
+
+    static constexpr int CLASS_COUNT = 5;
+    static constexpr size_t CLASS_SIZES[CLASS_COUNT] = {64, 128, 256, 512, 1024};
+    static constexpr int STATE_CLASS_COUNT = 3; //共享状态不超过256字节，更大的等级给协程帧用
+    static constexpr size_t BLOCK_ALIGN = 64;
+    static constexpr size_t BLOCKS_PER_CHUNK = 64;
+
+    static int sizeClass(size_t size, size_t align)
+    {
+        if(align > BLOCK_ALIGN) return -1;
+        for(int i = 0; i < CLASS_COUNT; i++)
+        {
+            if(size <= CLASS_SIZES[i]) return i;
+        }
+        return -1;
+    }
+
+    //调用时持有b.mtx
+    void grow(Bucket& b, size_t blockSize)
+    {
+        char* chunk = static_cast<char*>(::operator new(blockSize * BLOCKS_PER_CHUNK, std::align_val_t(BLOCK_ALIGN)));
+        b.chunks.push_back(chunk);
+        for(size_t i = 0; i < BLOCKS_PER_CHUNK; i++)
+        {
+            Block* blk = reinterpret_cast<Block*>(chunk + i * blockSize);
+            blk->next = b.local;
+            b.local = blk;
+        }
+    }
+
+private:
+    Bucket buckets_[CLASS_COUNT];
+    std::atomic<int> refs_;
+};
+
+
+//get()/wait()先自旋这么多次再挂起，短任务通常在自旋期间就完成了
+const int FUTURE_SPIN_COUNT = 128;
+
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+//在状态字上挂起/唤醒，Linux上直接用futex，共享状态本身不需要锁和条件变量
+//其他平台按地址散列到固定的一组互斥锁+条件变量上
+#ifdef __linux__
+
+//*addr仍等于expected时挂起，被唤醒、值已改变或超时后返回(可能虚假唤醒，调用者需要循环检查)
+inline void futureParkWait(std::atomic<uint32_t>* addr, uint32_t expected,
+    const std::chrono::nanoseconds* timeout = nullptr)
+{
+    struct timespec ts;
+    struct timespec* pts = nullptr;
+    if(timeout != nullptr)
+    {
+        ts.tv_sec = (time_t)(timeout->count() / 1000000000);
+        ts.tv_nsec = (long)(timeout->count() % 1000000000);
+        pts = &ts;
+    }
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, pts, nullptr, 0);
+}
+
+inline void futureParkWakeAll(std::atomic<uint32_t>* addr)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+struct FutureWaitBucket
+{
+    std::mutex mtx;
+    std::condition_variable cond;
+};
+
+inline FutureWaitBucket& futureWaitBucket(const void* addr)
+{
+    static FutureWaitBucket table[64];
+    return table[(reinterpret_cast<uintptr_t>(addr) >> 6) % 64];
+}
+
+inline void futureParkWait(std::atomic<uint32_t>* addr, uint32_t expected,
+    const std::chrono::nanoseconds* timeout = nullptr)
+{
+    FutureWaitBucket& b = futureWaitBucket(addr);
+    std::unique_lock<std::mutex> lock(b.mtx);
+    if(addr->load(std::memory_order_acquire) != expected) return;
+    if(timeout != nullptr)
+    {
+        b.cond.wait_for(lock, *timeout);
+    }
+    else
+    {
+        b.cond.wait(lock);
+    }
+}
+
+inline void futureParkWakeAll(std::atomic<uint32_t>* addr)
+{
+    FutureWaitBucket& b = futureWaitBucket(addr);
+    {
+        std::lock_guard<std::mutex> lock(b.mtx);
+    }
+    b.cond.notify_all();
+}
+
+#endif
+
+
+#include "task_function.h"
+
+
+class ExecutorHandle;
+
+//then()/when_all()/when_any()的后续任务交给executor执行，线程池实现这个接口
+//没有executor的future(全局内存池创建的Promise)在完成它的线程里直接执行后续任务
+//future的共享状态不保存executor的指针，而是持有它的句柄，executor销毁之后完成的future不会再访问它
+class FutureExecutor
+{
+public:
+    //由完成前驱的线程调用，不能阻塞
+    virtual void execute(TaskFunc&& task) = 0;
+
+    ExecutorHandle* handle() const { return handle_; }
+
+    FutureExecutor(const FutureExecutor&) = delete;
+    FutureExecutor& operator=(const FutureExecutor&) = delete;
+
+protected:
+    FutureExecutor();
+    ~FutureExecutor();
+
+    //关闭时调用：等正在派发的后续任务返回，之后的后续任务在完成前驱的线程里直接执行
+    void invalidateHandle();
+
+private:
+    ExecutorHandle* handle_;
+};
+
+//FutureExecutor的引用计数句柄，executor和每个挂着它的共享状态各持有一份，最后一个释放时析构
+//state_的最低位表示executor已经失效，其余位是正在通过句柄派发的线程数
+class ExecutorHandle
+{
+public:
+    explicit ExecutorHandle(FutureExecutor* executor)
+        :executor_(executor)
+        ,state_(0)
+        ,refs_(1)
+    {}
+
+    void retain()
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if(refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete this;
+        }
+    }
+
+    //executor还有效时把task交给它，返回true；已经失效返回false，task保持不变
+    bool execute(TaskFunc& task)
+    {
+        if(state_.fetch_add(2, std::memory_order_acquire) & 1)
+        {
+            state_.fetch_sub(2, std::memory_order_release);
+            return false;
+        }
+        executor_->execute(std::move(task));
+        state_.fetch_sub(2, std::memory_order_release);
+        return true;
+    }
+
+    //之后的execute都返回false；返回前等正在派发的线程离开executor
+    void invalidate()
+    {
+        state_.fetch_or(1, std::memory_order_acq_rel);
+        while(state_.load(std::memory_order_acquire) != 1)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    ExecutorHandle(const ExecutorHandle&) = delete;
+    ExecutorHandle& operator=(const ExecutorHandle&) = delete;
+
+private:
+    FutureExecutor* executor_;
+    std::atomic<uint32_t> state_;
+    std::atomic<uint32_t> refs_;
+};
+
+inline FutureExecutor::FutureExecutor()
+    :handle_(new ExecutorHandle(this))
+{}
+
+inline FutureExecutor::~FutureExecutor()
+{
+    handle_->invalidate();
+    handle_->release();
+}
+
+inline void FutureExecutor::invalidateHandle()
+{
+    handle_->invalidate();
+}
+
+
+//池内线程get()/wait()一个还没完成的future时，不直接挂起，而是帮线程池执行排队的任务，线程池实现这个接口
+//任务里嵌套提交子任务再等待它们，在固定数量的线程上也不会因为所有线程都在等待而死锁
+class FutureHelper
+{
+public:
+    //当前线程现在能不能帮忙(比如在阻塞区域里就不能)，不能时直接挂起等待
+    virtual bool canHelp() = 0;
+    //在当前线程执行一个可以取到的任务，没有任务返回false
+    virtual bool helpOne() = 0;
+    //帮忙嵌套太深、改为挂起等待时前后各调用一次，线程池可以补充线程，防止所有线程都挂起
+    virtual void enterWait() {}
+    virtual void leaveWait() {}
+
+protected:
+    ~FutureHelper() = default;
+};
+
+//当前线程所属线程池的helper，工作线程启动时设置，池外线程为nullptr
+inline FutureHelper*& currentFutureHelper()
+{
+    static thread_local FutureHelper* helper = nullptr;
+    return helper;
+}
+
+//当前线程嵌套在帮忙执行的任务里的层数
+inline int& futureHelpDepth()
+{
+    static thread_local int depth = 0;
+    return depth;
+}
+
+//为true时本线程上的Promise::setFromCall不再调用任务，直接把结果设置为TaskCancelledError
+//线程池按SHUTDOWN_CANCEL关闭时用它把还在排队的任务取出来作废，不用知道任务里的promise是什么类型
+inline bool& futureCancelCalls()
+{
+    static thread_local bool cancel = false;
+    return cancel;
+}
+
+//帮忙时取不到任务就在状态字上挂起一会儿再回来找任务，挂起时间从最小值开始翻倍
+const int FUTURE_HELP_PARK_MIN_US = 50;
+const int FUTURE_HELP_PARK_MAX_US = 1000;
+//帮忙执行的任务里再等待会继续嵌套，固定/cached模式的FIFO队列取到的多半是无关的任务，层数不加限制会栈溢出
+//工作窃取模式先取本地队列里刚提交的子任务，嵌套层数和递归深度相当
+const int FUTURE_HELP_MAX_DEPTH = 256;
+
+
+//共享状态中与值类型无关的部分
+//state_低两位是状态，第三位表示有线程在等待；设置结果先把状态从PENDING抢到SETTING，只有第一个设置者生效
+class FutureStateBase
+{
+public:
+    enum : uint32_t
+    {
+        STATE_PENDING = 0,
+        STATE_SETTING = 1,
+        STATE_READY = 2,
+        STATE_ERROR = 3,
+        STATE_MASK = 3,
+        STATE_WAITERS = 4,
+        STATE_CONTINUATION = 8, //已经挂上了后续任务
+        STATE_RUNNING = 16, //产生结果的任务已经开始执行，不能再取消
+    };
+
+    bool isReady() const
+    {
+        return (state_.load(std::memory_order_acquire) & STATE_MASK) >= STATE_READY;
+    }
+
+    bool hasError() const
+    {
+        return (state_.load(std::memory_order_acquire) & STATE_MASK) == STATE_ERROR;
+    }
+
+    //设置异常，已经有结果时返回false
+    bool trySetException(std::exception_ptr e)
+    {
+        if(!claim()) return false;
+        error_ = std::move(e);
+        publish(STATE_ERROR);
+        return true;
+    }
+
+    //产生结果的任务开始执行前调用：还没有结果时标记为运行中，之后tryCancel不再生效
+    //已经有结果(被取消了)时返回false，任务不用再执行
+    bool markRunning()
+    {
+        uint32_t s = state_.load(std::memory_order_acquire);
+        do
+        {
+            if((s & STATE_MASK) != STATE_PENDING) return false;
+            if(s & STATE_RUNNING) return true;
+        } while(!state_.compare_exchange_weak(s, s | STATE_RUNNING,
+            std::memory_order_acq_rel, std::memory_order_acquire));
+        return true;
+    }
+
+    //取消还没开始执行的任务，结果设置为TaskCancelledError；任务已经开始或已经有结果时返回false
+    bool tryCancel()
+    {
+        uint32_t s = state_.load(std::memory_order_relaxed);
+        do
+        {
+            if((s & STATE_MASK) != STATE_PENDING || (s & STATE_RUNNING)) return false;
+        } while(!state_.compare_exchange_weak(s, s | STATE_SETTING,
+            std::memory_order_acquire, std::memory_order_relaxed));
+        error_ = std::make_exception_ptr(TaskCancelledError());
+        publish(STATE_ERROR);
+        return true;
+    }
+
+    //先自旋一小段时间，还没完成再在状态字上挂起
+    //池内线程上等待时改为帮线程池执行任务
+    //带超时的等待不帮忙：执行一个任务的时间没有上限，会睡过截止时间
+    void wait()
+    {
+        if(spinUntilReady()) return;
+        FutureHelper* helper = currentFutureHelper();
+        if(helper != nullptr && helper->canHelp())
+        {
+            if(futureHelpDepth() < FUTURE_HELP_MAX_DEPTH)
+            {
+                helpUntilReady(helper);
+                return;
+            }
+            helper->enterWait();
+            parkUntilReady();
+            helper->leaveWait();
+            return;
+        }
+        parkUntilReady();
+    }
+
+    template<typename Clock, typename Duration>
+    bool waitUntil(const std::chrono::time_point<Clock, Duration>& deadline)
+    {
+        if(spinUntilReady()) return true;
+        uint32_t s = state_.load(std::memory_order_acquire);
+        while((s & STATE_MASK) < STATE_READY)
+        {
+            auto now = Clock::now();
+            if(now >= deadline) return false;
+            if(markWaiting(s))
+            {
+                //超时时间按剩余时间计算，最长一次等1秒，防止时钟被调整后睡过头
+                std::chrono::nanoseconds rel = std::min<std::chrono::nanoseconds>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now),
+                    std::chrono::seconds(1));
+                futureParkWait(&state_, s, &rel);
+            }
+            s = state_.load(std::memory_order_acquire);
+        }
+        return true;
+    }
+
+    void retain()
+    {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release()
+    {
+        if(refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            destroy_(this);
+        }
+    }
+
+    const std::exception_ptr& error() const { return error_; }
+
+    StatePool* pool() const { return pool_; }
+    ExecutorHandle* executor() const { return executor_; }
+
+    //挂上后续任务，每个状态只能挂一个；已经完成时立即派发
+    //runInline为true时在完成它的线程里直接执行(只用于when_all/when_any内部的计数)，否则交给executor
+    void setContinuation(TaskFunc&& cont, bool runInline)
+    {
+        continuation_ = std::move(cont);
+        continuationInline_ = runInline;
+        uint32_t s = state_.load(std::memory_order_acquire);
+        for(;;)
+        {
+            if((s & STATE_MASK) >= STATE_READY)
+            {
+                dispatchContinuation();
+                return;
+            }
+            if(state_.compare_exchange_weak(s, s | STATE_CONTINUATION,
+                std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                return;
+            }
+        }
+    }
+
+protected:
+    using DestroyFunc = void (*)(FutureStateBase*);
+
+    FutureStateBase(StatePool* pool, ExecutorHandle* executor, DestroyFunc destroy)
+        :state_(STATE_PENDING)
+        ,refs_(1)
+        ,pool_(pool)
+        ,executor_(executor)
+        ,destroy_(destroy)
+        ,continuationInline_(false)
+    {
+        if(executor_ != nullptr) executor_->retain();
+    }
+    ~FutureStateBase()
+    {
+        if(executor_ != nullptr) executor_->release();
+    }
+
+    bool claim()
+    {
+        uint32_t s = state_.load(std::memory_order_relaxed);
+        do
+        {
+            if((s & STATE_MASK) != STATE_PENDING) return false;
+        } while(!state_.compare_exchange_weak(s, s | STATE_SETTING,
+            std::memory_order_acquire, std::memory_order_relaxed));
+        return true;
+    }
+
+    //只有设置过STATE_WAITERS(有线程挂起)才需要系统调用唤醒
+    void publish(uint32_t status)
+    {
+        uint32_t old = state_.exchange(status, std::memory_order_acq_rel);
+        if(old & STATE_WAITERS)
+        {
+            futureParkWakeAll(&state_);
+        }
+        if(old & STATE_CONTINUATION)
+        {
+            dispatchContinuation();
+        }
+    }
+
+    //后续任务先从状态里移出来再执行，它持有的对本状态的引用在执行完后释放
+    //executor已经关闭或者销毁时在当前线程直接执行
+    void dispatchContinuation()
+    {
+        TaskFunc task = std::move(continuation_);
+        if(continuationInline_ || executor_ == nullptr || !executor_->execute(task))
+        {
+            task();
+        }
+    }
+
+    bool spinUntilReady() const
+    {
+        for(int i = 0; i < FUTURE_SPIN_COUNT; i++)
+        {
+            if(isReady()) return true;
+            cpuRelax();
+        }
+        return isReady();
+    }
+
+    //一直执行线程池里的任务直到完成
+    //被执行的任务可能正是等待的那个(本地队列后进先出，刚提交的子任务最先取到)
+    //取不到任务说明等待的任务正在别的线程上运行，短暂挂起后再找，期间完成会被futex唤醒
+    void helpUntilReady(FutureHelper* helper)
+    {
+        struct DepthGuard
+        {
+            DepthGuard() { futureHelpDepth()++; }
+            ~DepthGuard() { futureHelpDepth()--; }
+        } guard;
+        std::chrono::nanoseconds park = std::chrono::microseconds(FUTURE_HELP_PARK_MIN_US);
+        for(;;)
+        {
+            if(isReady()) return;
+            if(helper->helpOne())
+            {
+                park = std::chrono::microseconds(FUTURE_HELP_PARK_MIN_US);
+                continue;
+            }
+            uint32_t s = state_.load(std::memory_order_acquire);
+            if((s & STATE_MASK) >= STATE_READY) return;
+            if(markWaiting(s))
+            {
+                futureParkWait(&state_, s, &park);
+            }
+            park = std::min<std::chrono::nanoseconds>(park * 2, std::chrono::microseconds(FUTURE_HELP_PARK_MAX_US));
+        }
+    }
+
+    void parkUntilReady()
+    {
+        uint32_t s = state_.load(std::memory_order_acquire);
+        while((s & STATE_MASK) < STATE_READY)
+        {
+            if(markWaiting(s))
+            {
+                futureParkWait(&state_, s);
+            }
+            s = state_.load(std::memory_order_acquire);
+        }
+    }
+
+    //挂起前在状态字上设置STATE_WAITERS，s更新为设置后的值；状态已经变化时返回false，调用者重新检查
+    bool markWaiting(uint32_t& s)
+    {
+        if(s & STATE_WAITERS) return true;
+        if(!state_.compare_exchange_strong(s, s | STATE_WAITERS,
+            std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            return false;
+        }
+        s |= STATE_WAITERS;
+        return true;
+    }
+
+    std::atomic<uint32_t> state_;
+    std::atomic<uint32_t> refs_;
+    StatePool* pool_;
+    ExecutorHandle* executor_;
+    DestroyFunc destroy_;
+    bool continuationInline_;
+    std::exception_ptr error_;
+    TaskFunc continuation_;
+};
+
+
+//带值的共享状态，从StatePool里分配，值直接存放在状态块内
+template<typename T>
+class FutureState : public FutureStateBase
+{
+public:
+    //引用类型存成指针，void不占空间
+    using Stored = typename std::conditional<std::is_void<T>::value, char,
+        typename std::conditional<std::is_reference<T>::value,
+            typename std::remove_reference<T>::type*, T>::type>::type;
+
+    static FutureState* create(StatePool* pool, ExecutorHandle* executor = nullptr)
+    {
+        void* mem = pool->allocate(sizeof(FutureState), alignof(FutureState));
+        return new (mem) FutureState(pool, executor);
+    }
+
+    template<typename... V>
+    bool trySetValue(V&&... v)
+    {
+        if(!claim()) return false;
+        try
+        {
+            if constexpr(std::is_void<T>::value)
+            {
+            }
+            else if constexpr(std::is_reference<T>::value)
+            {
+                new (storage_) Stored(&v...);
+            }
+            else
+            {
+                new (storage_) Stored(std::forward<V>(v)...);
+            }
+        }
+        catch(...)
+        {
+            error_ = std::current_exception();
+            publish(STATE_ERROR);
+            return true;
+        }
+        publish(STATE_READY);
+        return true;
+    }
+
+    Stored& value() { return *std::launder(reinterpret_cast<Stored*>(storage_)); }
+
+private:
+    FutureState(StatePool* pool, ExecutorHandle* executor)
+        :FutureStateBase(pool, executor, &destroyState)
+    {}
+
+    static void destroyState(FutureStateBase* base)
+    {
+        FutureState* s = static_cast<FutureState*>(base);
+        StatePool* pool = s->pool_;
+        if(!std::is_void<T>::value && (s->state_.load(std::memory_order_relaxed) & STATE_MASK) == STATE_READY)
+        {
+            s->value().~Stored();
+        }
+        s->~FutureState();
+        pool->deallocate(s, sizeof(FutureState), alignof(FutureState));
+    }
+
+    alignas(Stored) unsigned char storage_[sizeof(Stored)];
+};
+
+
+template<typename T> class Promise;
+template<typename T> class Future;
+struct FutureAccess;
+
+
+//then()回调的调用方式：能接收Future<T>就传入已经完成的future(可以自己处理异常)
+//否则传入get()的结果，前驱的异常直接传给then()返回的future
+template<typename T, typename F>
+auto invokeContinuation(F& f, Future<T>&& input)
+{
+    if constexpr(std::is_invocable<F&, Future<T>&&>::value)
+    {
+        return f(std::move(input));
+    }
+    else if constexpr(std::is_void<T>::value)
+    {
+        input.get();
+        return f();
+    }
+    else
+    {
+        return f(input.get());
+    }
+}
+
+
+//线程池返回的future，接口和std::future一致(get/wait/wait_for/wait_until/valid)
+//共享状态来自线程池的StatePool，不单独new，没有shared_ptr控制块
+template<typename T>
+class Future
+{
+public:
+    Future() noexcept : state_(nullptr) {}
+
+    Future(Future&& other) noexcept
+        :state_(other.state_)
+    {
+        other.state_ = nullptr;
+    }
+
+    Future& operator=(Future&& other) noexcept
+    {
+        if(this != &other)
+        {
+            if(state_ != nullptr) state_->release();
+            state_ = other.state_;
+            other.state_ = nullptr;
+        }
+        return *this;
+    }
+
+    Future(const Future&) = delete;
+    Future& operator=(const Future&) = delete;
+
+    ~Future()
+    {
+        if(state_ != nullptr) state_->release();
+    }
+
+    bool valid() const noexcept { return state_ != nullptr; }
+
+    bool isReady() const
+    {
+        checkState();
+        return state_->isReady();
+    }
+
+    void wait() const
+    {
+        checkState();
+        state_->wait();
+    }
+
+    template<typename Rep, typename Period>
+    std::future_status wait_for(const std::chrono::duration<Rep, Period>& dur) const
+    {
+        return wait_until(std::chrono::steady_clock::now() + dur);
+    }
+
+    template<typename Clock, typename Duration>
+    std::future_status wait_until(const std::chrono::time_point<Clock, Duration>& deadline) const
+    {
+        checkState();
+        return state_->waitUntil(deadline) ? std::future_status::ready : std::future_status::timeout;
+    }
+
+    //完成后把f交给产生这个future的线程池执行，返回f结果的future，调用后本future失效
+    //等待期间不占用任何线程；没有线程池的future在完成它的线程里直接执行f
+    template<typename F>
+    auto then(F&& f) -> Future<decltype(invokeContinuation<T>(
+        std::declval<typename std::decay<F>::type&>(), std::declval<Future<T>>()))>
+    {
+        using Fn = typename std::decay<F>::type;
+        using R = decltype(invokeContinuation<T>(std::declval<Fn&>(), std::declval<Future<T>>()));
+        checkState();
+        FutureState<T>* s = state_;
+        Promise<R> promise(s->pool(), s->executor());
+        Future<R> result = promise.getFuture();
+        //后续任务持有本future，执行时它已经完成
+        s->setContinuation([input = std::move(*this), promise = std::move(promise),
+            fn = Fn(std::forward<F>(f))]() mutable
+        {
+            promise.setFromCall([&]()->R{ return invokeContinuation<T>(fn, std::move(input)); });
+        }, false);
+        return result;
+    }
+
+    //取消还没开始执行的任务：future立即得到TaskCancelledError，任务之后被取出时直接跳过
+    //任务已经开始执行、已经完成或future已经get过时返回false，正在运行的任务要靠CancellationToken(见cancellation.h)协作停止
+    bool cancel()
+    {
+        return state_ != nullptr && state_->tryCancel();
+    }
+
+    //阻塞直到结果就绪，取出结果后future失效，和std::future一样只能get一次
+    T get()
+    {
+        checkState();
+        state_->wait();
+        FutureState<T>* s = state_;
+        state_ = nullptr;
+        struct Releaser
+        {
+            FutureState<T>* s;
+            ~Releaser() { s->release(); }
+        } releaser{s};
+
+        if(s->hasError())
+        {
+            std::rethrow_exception(s->error());
+        }
+        if constexpr(std::is_void<T>::value)
+        {
+            return;
+        }
+        else if constexpr(std::is_reference<T>::value)
+        {
+            return *s->value();
+        }
+        else
+        {
+            return std::move(s->value());
+        }
+    }
+
+private:
+    friend class Promise<T>;
+    friend struct FutureAccess;
+    template<typename U> friend void setFutureException(Future<U>& fut, std::exception_ptr e);
+
+    explicit Future(FutureState<T>* state) : state_(state) {}
+
+    void checkState() const
+    {
+        if(state_ == nullptr)
+        {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+
+    FutureState<T>* state_;
+};
+
+//线程池内部使用：任务还没执行就直接让future失败(例如队列满被拒绝)，已经有结果时不起作用
+template<typename T>
+void setFutureException(Future<T>& fut, std::exception_ptr e)
+{
+    if(fut.state_ != nullptr)
+    {
+        fut.state_->trySetException(std::move(e));
+    }
+}
+
+
+//和Future配对的promise，析构时还没设置结果则future得到broken_promise异常
+template<typename T>
+class Promise
+{
+public:
+    Promise() : Promise(StatePool::global()) {}
+
+    //executor不为空时，future上的then()后续任务交给它执行
+    explicit Promise(StatePool* pool, FutureExecutor* executor = nullptr)
+        :Promise(pool, executor != nullptr ? executor->handle() : nullptr)
+    {}
+
+    //then()/when_all()的结果沿用前驱的executor句柄
+    Promise(StatePool* pool, ExecutorHandle* executor)
+        :state_(FutureState<T>::create(pool, executor))
+        ,futureRetrieved_(false)
+    {}
+
+    //没有共享状态的空promise，之后再移动赋值
+    Promise(std::nullptr_t) noexcept
+        :state_(nullptr)
+        ,futureRetrieved_(false)
+    {}
+
+    Promise(Promise&& other) noexcept
+        :state_(other.state_)
+        ,futureRetrieved_(other.futureRetrieved_)
+    {
+        other.state_ = nullptr;
+    }
+
+    Promise& operator=(Promise&& other) noexcept
+    {
+        if(this != &other)
+        {
+            abandon();
+            state_ = other.state_;
+            futureRetrieved_ = other.futureRetrieved_;
+            other.state_ = nullptr;
+        }
+        return *this;
+    }
+
+    Promise(const Promise&) = delete;
+    Promise& operator=(const Promise&) = delete;
+
+    ~Promise()
+    {
+        abandon();
+    }
+
+    bool valid() const noexcept { return state_ != nullptr; }
+
+    Future<T> getFuture()
+    {
+        if(state_ == nullptr) throw std::future_error(std::future_errc::no_state);
+        if(futureRetrieved_) throw std::future_error(std::future_errc::future_already_retrieved);
+        futureRetrieved_ = true;
+        state_->retain();
+        return Future<T>(state_);
+    }
+
+    template<typename... V>
+    void setValue(V&&... v)
+    {
+        if(state_ == nullptr) throw std::future_error(std::future_errc::no_state);
+        if(!state_->trySetValue(std::forward<V>(v)...))
+        {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+    }
+
+    void setException(std::exception_ptr e)
+    {
+        if(state_ == nullptr) throw std::future_error(std::future_errc::no_state);
+        if(!state_->trySetException(std::move(e)))
+        {
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+        }
+    }
+
+    //执行f()，把返回值或抛出的异常设置为结果
+    //执行前先标记为运行中，已经被取消(已经有结果)或者处在futureCancelCalls()下时不再执行f
+    template<typename F>
+    void setFromCall(F&& f)
+    {
+        if(futureCancelCalls())
+        {
+            state_->tryCancel();
+            return;
+        }
+        if(!state_->markRunning()) return;
+        try
+        {
+            if constexpr(std::is_void<T>::value)
+            {
+                std::forward<F>(f)();
+                state_->trySetValue();
+            }
+            else
+            {
+                state_->trySetValue(std::forward<F>(f)());
+            }
+        }
+        catch(...)
+        {
+            state_->trySetException(std::current_exception());
+        }
+    }
+
+private:
+    void abandon()
+    {
+        if(state_ == nullptr) return;
+        if(!state_->isReady())
+        {
+            state_->trySetException(std::make_exception_ptr(
+                std::future_error(std::future_errc::broken_promise)));
+        }
+        state_->release();
+        state_ = nullptr;
+    }
+
+    FutureState<T>* state_;
+    bool futureRetrieved_;
+};
+
+
+//when_all/when_any内部访问future的共享状态
+struct FutureAccess
+{
+    template<typename T>
+    static FutureStateBase* state(const Future<T>& fut) { return fut.state_; }
+
+    template<typename T, typename F>
+    static void forEachState(std::vector<Future<T>>& futures, F&& f)
+    {
+        for(size_t i = 0; i < futures.size(); i++)
+        {
+            f(i, state(futures[i]));
+        }
+    }
+
+    template<typename... Ts, typename F>
+    static void forEachState(std::tuple<Future<Ts>...>& futures, F&& f)
+    {
+        size_t i = 0;
+        std::apply([&](Future<Ts>&... fs){ (f(i++, state(fs)), ...); }, futures);
+    }
+
+    //检查所有输入都有效，返回第一个输入所属的内存池和executor，组合结果也交给它
+    template<typename Sequence>
+    static std::pair<StatePool*, ExecutorHandle*> origin(Sequence& futures)
+    {
+        std::pair<StatePool*, ExecutorHandle*> result(nullptr, nullptr);
+        forEachState(futures, [&](size_t, FutureStateBase* s)
+        {
+            if(s == nullptr) throw std::future_error(std::future_errc::no_state);
+            if(result.first == nullptr) result = std::make_pair(s->pool(), s->executor());
+        });
+        if(result.first == nullptr) result.first = StatePool::global();
+        return result;
+    }
+};
+
+
+//when_all：所有输入完成后，返回的future得到全部输入(都已完成，逐个get取结果或异常)
+//计数多加一，挂完所有后续任务后再减掉，防止挂的过程中输入被提前移走
+template<typename Sequence>
+class WhenAllContext
+{
+public:
+    WhenAllContext(Sequence&& futures, std::pair<StatePool*, ExecutorHandle*> origin)
+        :remaining_(1)
+        ,futures_(std::move(futures))
+        ,promise_(origin.first, origin.second)
+    {}
+
+    static Future<Sequence> start(Sequence&& futures)
+    {
+        auto origin = FutureAccess::origin(futures);
+        auto ctx = std::make_shared<WhenAllContext>(std::move(futures), origin);
+        Future<Sequence> result = ctx->promise_.getFuture();
+        FutureAccess::forEachState(ctx->futures_, [&](size_t, FutureStateBase* s)
+        {
+            ctx->remaining_.fetch_add(1, std::memory_order_relaxed);
+            s->setContinuation([ctx](){ ctx->arrive(); }, true);
+        });
+        ctx->arrive();
+        return result;
+    }
+
+private:
+    void arrive()
+    {
+        if(remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            promise_.setValue(std::move(futures_));
+        }
+    }
+
+    std::atomic<size_t> remaining_;
+    Sequence futures_;
+    Promise<Sequence> promise_;
+};
+
+template<typename T>
+Future<std::vector<Future<T>>> when_all(std::vector<Future<T>> futures)
+{
+    return WhenAllContext<std::vector<Future<T>>>::start(std::move(futures));
+}
+
+template<typename... Ts>
+Future<std::tuple<Future<Ts>...>> when_all(Future<Ts>... futures)
+{
+    return WhenAllContext<std::tuple<Future<Ts>...>>::start(std::make_tuple(std::move(futures)...));
+}
+
+
+//when_any的结果：最先完成的输入下标和全部输入
+template<typename Sequence>
+struct WhenAnyResult
+{
+    size_t index;
+    Sequence futures;
+};
+
+//when_any：任意一个输入完成后，返回的future得到它的下标和全部输入，没有输入时下标为size_t(-1)
+//第一个完成的输入和挂完后续任务的调用者各减一次gate_，第二个减到0的负责设置结果
+template<typename Sequence>
+class WhenAnyContext
+{
+public:
+    static constexpr size_t NONE = size_t(-1);
+
+    WhenAnyContext(Sequence&& futures, std::pair<StatePool*, ExecutorHandle*> origin)
+        :winner_(NONE)
+        ,gate_(2)
+        ,futures_(std::move(futures))
+        ,promise_(origin.first, origin.second)
+    {}
+
+    static Future<WhenAnyResult<Sequence>> start(Sequence&& futures)
+    {
+        auto origin = FutureAccess::origin(futures);
+        auto ctx = std::make_shared<WhenAnyContext>(std::move(futures), origin);
+        Future<WhenAnyResult<Sequence>> result = ctx->promise_.getFuture();
+        bool empty = true;
+        FutureAccess::forEachState(ctx->futures_, [&](size_t i, FutureStateBase* s)
+        {
+            empty = false;
+            s->setContinuation([ctx, i](){ ctx->arrive(i); }, true);
+        });
+        if(empty)
+        {
+            ctx->promise_.setValue(WhenAnyResult<Sequence>{NONE, std::move(ctx->futures_)});
+            return result;
+        }
+        ctx->leave();
+        return result;
+    }
+
+private:
+    void arrive(size_t i)
+    {
+        size_t expected = NONE;
+        if(winner_.compare_exchange_strong(expected, i, std::memory_order_acq_rel))
+        {
+            leave();
+        }
+    }
+
+    void leave()
+    {
+        if(gate_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            promise_.setValue(WhenAnyResult<Sequence>{winner_.load(std::memory_order_acquire), std::move(futures_)});
+        }
+    }
+
+    std::atomic<size_t> winner_;
+    std::atomic<int> gate_;
+    Sequence futures_;
+    Promise<WhenAnyResult<Sequence>> promise_;
+};
+
+template<typename T>
+Future<WhenAnyResult<std::vector<Future<T>>>> when_any(std::vector<Future<T>> futures)
+{
+    return WhenAnyContext<std::vector<Future<T>>>::start(std::move(futures));
+}
+
+template<typename... Ts>
+Future<WhenAnyResult<std::tuple<Future<Ts>...>>> when_any(Future<Ts>... futures)
+{
+    return WhenAnyContext<std::tuple<Future<Ts>...>>::start(std::make_tuple(std::move(futures)...));
+}
+
+
+#endif
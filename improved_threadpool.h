@@ -3,7 +3,6 @@
 
 
 #include <vector>
-#include <queue>
 #include <memory>
 #include <atomic>
 #include <mutex>
@@ -12,17 +11,93 @@
 #include <unordered_map>
 #include <thread>
 #include <future>
+#include <chrono>
+#include <random>
+#include <stdexcept>
+#include <tuple>
+#include <algorithm>
+#include <cstdint>
 
+#include "work_stealing_deque.h"
+#include "mpmc_queue.h"
+#include "parking_lot.h"
+#include "task_function.h"
+#include "future.h"
+#include "topology.h"
+#include "pool_stats.h"
+#include "elastic_controller.h"
+#include "timer_wheel.h"
+#include "cancellation.h"
+#include "arena.h"
+#include "strand.h"
 
-//最大任务数量
-const int TASK_MAX_THRESHHOLD = INT32_MAX;
+
+//最大任务数量，任务队列是预先分配的环形缓冲区，不能再用INT32_MAX
+const int TASK_MAX_THRESHHOLD = 1 << 16;
 const int THREAD_MAX_THRESHHOLD = 100;
-const int THREAD_MAX_IDLE_TIME = 60; //单位：秒
+const int SUBMIT_SPIN_COUNT = 64; //POLICY_SPIN_PARK下挂起前的自旋次数
+const int IDLE_SPIN_COUNT = 16; //IDLE_SPIN_PARK下工作线程没有任务时挂起前让出cpu的次数
+const int IDLE_PAUSE_COUNT = 256; //IDLE_SPIN_PARK下让出cpu之前用pause指令自旋的次数，大约几微秒
+const int IDLE_POLL_CHECK = 64; //IDLE_BUSY_POLL下每自旋这么多次检查一次线程池是否停止、本线程是否该退出
+const int NODE_CHUNK_SIZE = 256; //工作窃取模式下每个线程第一次分配的任务节点数，之后每块和已有的节点一样多
+const int PRIORITY_AGING_LIMIT = 16; //低优先级车道非空时最多连续被跳过的次数，之后先取它一次
+const int NUMA_PREFAULT_STATES = 1024; //首次访问分配时每个节点的工作线程预先准备的共享状态块数
+const int KEYED_STRAND_COUNT = 256; //submitKeyed按key散列到的strand数量
+const int BATCH_MAX_TASKS = 32; //DEQUEUE_BATCH下一次最多取出的任务数
 
 enum class PoolMode
 {
     MODE_FIXED, //固定数量的线程
-    MODE_CACHED, //线程数量可动态增长
+    MODE_CACHED, //线程数量由弹性控制器按排队等待和吞吐量伸缩
+    MODE_WORKSTEALING, //固定数量的线程，每个线程有自己的任务队列，空闲时从其他线程窃取
+};
+
+//任务队列满时提交者的处理策略
+enum class SubmitPolicy
+{
+    POLICY_BLOCK, //一直阻塞直到队列有空位
+    POLICY_SPIN_PARK, //先自旋一小段时间，再挂起等待
+    POLICY_TRY_ONCE, //只尝试一次，满了立即失败
+    POLICY_TIMED, //最多等待设置的超时时间
+};
+
+//任务优先级车道，不带优先级的submitTask进入PRIORITY_NORMAL
+enum class TaskPriority
+{
+    PRIORITY_HIGH, //延迟敏感的任务，总是先于普通和低优先级车道
+    PRIORITY_NORMAL, //默认车道
+    PRIORITY_LOW, //批量后台任务，靠老化保证不会饿死
+};
+
+//工作线程绑定cpu的方式
+enum class AffinityPolicy
+{
+    AFFINITY_NONE, //不绑定，由操作系统调度
+    AFFINITY_COMPACT, //依次填满一个节点的核心(含超线程)再用下一个，线程之间共享缓存
+    AFFINITY_SCATTER, //在节点和核心之间轮流分散，超线程最后才用，每个线程独占更多缓存和内存带宽
+    AFFINITY_EXPLICIT, //按给定的cpu列表，第i个线程绑定第i个cpu
+};
+
+//工作线程从注入队列取任务的方式
+enum class DequeueMode
+{
+    DEQUEUE_SINGLE, //每次取一个任务，延迟最低
+    DEQUEUE_BATCH, //每次取一批任务连续执行，计数和唤醒按批做一次，吞吐量优先
+};
+
+//工作线程找不到任务时怎样等待
+enum class IdleStrategy
+{
+    IDLE_BLOCK, //立即挂起，不占cpu，下一次提交要付出一次唤醒和调度的延迟
+    IDLE_SPIN_PARK, //先用pause指令自旋，再让出cpu几次，还没有任务才挂起
+    IDLE_BUSY_POLL, //一直自旋不挂起，延迟最低，适合每个工作线程独占一个核心的部署
+};
+
+//关闭线程池时怎样处理已经提交、还没执行的任务
+enum class ShutdownMode
+{
+    SHUTDOWN_DRAIN, //执行完所有已经提交的任务再退出
+    SHUTDOWN_CANCEL, //排队中的任务不再执行，future立即得到TaskCancelledError，只等正在运行的任务
 };
 
 
@@ -33,9 +108,13 @@ public:
     //线程函数对象类型
     using ThreadFunc = std::function<void(int)>;
     void start(){
-        //创建一个线程来执行一个线程函数
-        std::thread t(func_);   //c++11线程对象 和线程函数func_
-        t.detach(); //设置分离线程 pthread_detach    phread_t设置成分离线程
+        //创建一个线程来执行一个线程函数，线程对象由线程池持有，关闭时join，不再detach
+        thread_ = std::thread(func_, threadId_);   //c++11线程对象 和线程函数func_
+    }
+
+    //等线程函数返回；线程退出前把自己交给线程池，由别的线程join，不会join自己
+    void join(){
+        if(thread_.joinable()) thread_.join();
     }
 
     int getId()const{
@@ -47,19 +126,26 @@ public:
     :func_(func)
     ,threadId_(generateId_++)
 {}
-    ~Thread() = default;
-    
+    ~Thread(){
+        join();
+    }
+
 
 private:
    ThreadFunc func_;
-   static int generateId_;
+   static std::atomic_int generateId_; //多个线程池(线程池组)会同时创建线程
    int threadId_; //保存线程id
-     
+   std::thread thread_;
+
 };
 
+inline std::atomic_int Thread::generateId_(0);
 
 
-class ThreadPool
+
+//线程池同时是它返回的future的FutureExecutor，then()/when_all()的后续任务直接提交回线程池
+//也是工作线程的FutureHelper，池内线程等待future时帮忙执行任务
+class ThreadPool : public FutureExecutor, public FutureHelper
 {
 
 public:
@@ -67,38 +153,145 @@ public:
    //线程池构造
     ThreadPool()
     :initThreadSize_(0)
-    ,taskSize_(0)
-    ,idleThreadSize_(0)
     ,threadSizeThreshHold_(300)
+    ,idleThreadSize_(0)
+    ,taskSize_(0)
     ,taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD)
+    ,taskQue_(std::make_unique<MpmcQueue<Task>>(TASK_MAX_THRESHHOLD))
+    ,lanesInUse_(false)
+    ,normalSkips_(0)
+    ,lowSkips_(0)
+    ,edfSeq_(0)
+    ,edfSize_(0)
+    ,waitingProducers_(0)
+    ,submitPolicy_(SubmitPolicy::POLICY_BLOCK)
+    ,submitTimeout_(std::chrono::milliseconds(1000))
+    ,dequeueMode_(DequeueMode::DEQUEUE_SINGLE)
+    ,batchMax_(BATCH_MAX_TASKS)
+    ,batchSlotCount_(0)
+    ,batchHeld_(0)
+    ,idleStrategy_(IdleStrategy::IDLE_SPIN_PARK)
+    ,idlePauses_(autoIdlePauses())
+    ,idleYields_(IDLE_SPIN_COUNT)
+    ,statePool_(StatePool::create())
+    ,affinityPolicy_(AffinityPolicy::AFFINITY_NONE)
+    ,topology_(CpuTopology::system())
+    ,placementSeq_(0)
+    ,numaAware_(false)
+    ,numaFirstTouch_(false)
+    ,injectShards_(1)
+    ,injectNodes_(1)
+    ,tasksRejected_(0)
+    ,tasksExpired_(0)
+    ,tasksBorrowed_(0)
+    ,threadsCreated_(0)
+    ,threadsReclaimed_(0)
+    ,statsStop_(false)
+    ,lentActive_(0)
+    ,elasticTarget_(0)
+    ,elasticMin_(1)
+    ,retireTokens_(0)
+    ,lastSpawnNs_(0)
+    ,elasticStop_(false)
+    ,timerWake_(std::chrono::steady_clock::time_point::max())
+    ,timerStop_(false)
+    ,blockedWorkers_(0)
+    ,spareWorkers_(0)
+    ,shutdown_(false)
+    ,cancelPending_(false)
     ,poolMode_(PoolMode::MODE_FIXED)
     ,isPoolRunning_(false)
     {}
 
-    //线程池析构
+    //线程池析构：还没有关闭时按SHUTDOWN_DRAIN关闭，所有工作线程都join之后才释放队列
     ~ThreadPool(){
-    isPoolRunning_ = false;
-    notEmpty_.notify_all();
-    //等待线程池所有线程返回  有两种状态：阻塞&正在执行任务
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
-    exitCond_.wait(lock, [&]()->bool{return threads_.size()== 0;});  //队列还有就阻塞
+    shutdown(ShutdownMode::SHUTDOWN_DRAIN);
+    //和shutdown并发提交的定时任务可能又启动了定时线程
+    stopTimers();
+    timers_.reset();
+    for(int i = 0; i < batchSlotCount_; i++)
+    {
+        delete batchSlots_[i].que.load();
+    }
+    //还没取走结果的future仍然持有内存池的引用
+    statePool_->release();
+    for(StatePool* pool : statePools_)
+    {
+        pool->release();
     }
-    
+    }
+
     //开始任务
     void start(int initThreadSize = std::thread::hardware_concurrency())
     {
+        if(shutdown_) return; //关闭之后不能再启动
              //设置线程运行状态
         isPoolRunning_ = true;
-    
+
         //记录初始线程的数量
         initThreadSize_ = initThreadSize;
         curThreadSize_ = initThreadSize;
-    
+        threadsCreated_ += initThreadSize;
+
+        //工作窃取模式下每个线程一个本地队列，线程数量固定，启动前全部创建好
+        if(poolMode_ == PoolMode::MODE_WORKSTEALING)
+        {
+            for(int i = 0; i < initThreadSize; i++)
+            {
+                localQues_.emplace_back(std::make_unique<WorkStealingDeque<TaskNode*>>());
+            }
+            nodeCaches_ = std::vector<NodeCache>(initThreadSize);
+        }
+
+        //批量取任务时每个线程一个批队列槽位，cached模式按线程上限准备
+        if(dequeueMode_ == DequeueMode::DEQUEUE_BATCH && batchMax_ > 1)
+        {
+            batchSlotCount_ = initThreadSize;
+            if(poolMode_ == PoolMode::MODE_CACHED)
+            {
+                batchSlotCount_ = std::max({initThreadSize, threadSizeThreshHold_, elasticOptions_.maxThreads});
+            }
+            batchSlots_.reset(new BatchSlot[batchSlotCount_]);
+        }
+
+        //每个线程要绑定的cpu，NUMA感知且有多个节点时每个节点各自的注入队列，每个节点再按提交线程分成injectShards_片
+        //注入队列按 节点*分片数+分片 编号，0号使用taskQue_
+        placement_ = placementOrder();
+        injectNodes_ = numaAware_ && topology_.nodeCount() > 1 ? topology_.nodeCount() : 1;
+        if(injectNodes_ * injectShards_ > 1)
+        {
+            injectQues_.resize(injectNodes_ * injectShards_);
+            for(size_t i = 1; i < injectQues_.size(); i++)
+            {
+                injectQues_[i] = std::make_unique<MpmcQueue<Task>>(shardCapacity());
+            }
+        }
+        if(injectNodes_ > 1)
+        {
+            int nodes = injectNodes_;
+            if(numaFirstTouch_)
+            {
+                for(int n = 0; n < nodes; n++) statePools_.push_back(StatePool::create());
+            }
+            if(poolMode_ == PoolMode::MODE_WORKSTEALING)
+            {
+                for(int i = 0; i < initThreadSize; i++) workerNodes_.push_back(nodeOfSlot(i));
+            }
+        }
+
     //创建线程对象
-        for(int i = 0;i< initThreadSize_; i++)
+        for(int i = 0;i< initThreadSize; i++)
         {
         //创建线程对象的时候，把线程函数给到thread线程对象
-            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this,std::placeholders::_1));
+            std::unique_ptr<Thread> ptr;
+            if(poolMode_ == PoolMode::MODE_WORKSTEALING)
+            {
+                ptr = std::make_unique<Thread>([this, i](int threadid){ threadFunc(threadid, i); });
+            }
+            else
+            {
+                ptr = std::make_unique<Thread>([this](int threadid){ threadFunc(threadid, -1); });
+            }
         //unique_ptr无左值的拷贝赋值
             int threadId = ptr->getId();
             threads_.emplace(threadId,std::move(ptr));
@@ -106,12 +299,42 @@ public:
         }
 
     //集中启动所有线程
-        for(int i = 0;i< initThreadSize_; i++)
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        for(auto& it : threads_)
         {
-            threads_[i]->start();
+            it.second->start();
             idleThreadSize_++; //每启动一个线程，空闲++
 
         }
+        lock.unlock();
+
+        if(statsCallback_)
+        {
+            statsThread_ = std::thread([this](){ statsLoop(); });
+        }
+        if(poolMode_ == PoolMode::MODE_CACHED)
+        {
+            elasticTarget_ = initThreadSize;
+            elasticThread_ = std::thread([this](){ elasticLoop(); });
+        }
+    }
+
+    //关闭线程池并join所有工作线程，之后池外线程的提交直接失败，不能再start
+    //SHUTDOWN_DRAIN执行完已经提交的任务(包括它们执行时提交的子任务)；SHUTDOWN_CANCEL让排队中的任务得到TaskCancelledError
+    //还没到期的定时任务两种方式都取消；正在运行的任务不会被打断，CANCEL时它们通过CancellationToken::current()看到取消
+    //重复调用什么都不做，不能在本线程池的工作线程里调用
+    void shutdown(ShutdownMode mode = ShutdownMode::SHUTDOWN_DRAIN)
+    {
+        shutdownUntil(mode, std::chrono::steady_clock::time_point::max());
+    }
+
+    //有期限的关闭：先排空，timeout内没有执行完时剩下的任务按SHUTDOWN_CANCEL处理，按时排空返回true
+    //返回时所有线程都已经join，超时后还要等正在运行的任务返回
+    template<typename Rep, typename Period>
+    bool shutdownFor(const std::chrono::duration<Rep, Period>& timeout)
+    {
+        return shutdownUntil(ShutdownMode::SHUTDOWN_DRAIN,
+            std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
     }
 
 
@@ -121,214 +344,2088 @@ public:
          if(checkRunningState()) return;
          poolMode_ = mode;
     }
-    
-    //设置task任务队列上限阈值
+
+    //设置task任务队列上限阈值，环形队列容量会向上取整到2的幂
     void setTaskQueMaxThreshHold(int threshold)
     {
         if(checkRunningState()) return;
+        if(threshold <= 0) return;
         taskQueMaxThreshHold_ = threshold;
+        taskQue_ = std::make_unique<MpmcQueue<Task>>(shardCapacity());
+        //优先级车道和截止时间车道使用同样的上限
+        if(lanesInUse_)
+        {
+            highQue_ = std::make_unique<MpmcQueue<Task>>(threshold);
+            lowQue_ = std::make_unique<MpmcQueue<Task>>(threshold);
+        }
+    }
+    //把每个节点的注入队列按提交线程分成shards片，每个提交线程固定放进其中一片，工作线程轮流从各片取任务
+    //很多线程同时提交时不再都争抢同一个队列尾；上限阈值平均分给各片，提交者只等自己那一片的空位
+    void setInjectionShards(int shards)
+    {
+        if(checkRunningState()) return;
+        if(shards < 1) return;
+        injectShards_ = shards;
+        taskQue_ = std::make_unique<MpmcQueue<Task>>(shardCapacity());
+    }
+    //设置任务队列满时的提交策略，timeout只在POLICY_TIMED下使用
+    void setSubmitPolicy(SubmitPolicy policy,
+        std::chrono::milliseconds timeout = std::chrono::milliseconds(1000))
+    {
+        if(checkRunningState()) return;
+        submitPolicy_ = policy;
+        submitTimeout_ = timeout;
+    }
+    //设置工作线程取任务的方式，maxBatch只在DEQUEUE_BATCH下使用
+    //每批的大小按队列深度和线程数自适应，不超过maxBatch；批里还没执行的任务其他线程可以拿走
+    void setDequeueMode(DequeueMode mode, int maxBatch = BATCH_MAX_TASKS)
+    {
+        if(checkRunningState()) return;
+        if(maxBatch < 1) return;
+        dequeueMode_ = mode;
+        batchMax_ = maxBatch;
+    }
+    //设置工作线程空闲时的等待方式，pauses和yields只在IDLE_SPIN_PARK下使用
+    //默认IDLE_SPIN_PARK；pauses为-1时自动选择：只有一个cpu时不用pause自旋，提交者要等自旋的线程让出cpu才能运行
+    //stats()里的idleSpinHits/idleParks是自旋期间等到任务和最终挂起的次数
+    void setIdleStrategy(IdleStrategy strategy, int pauses = -1, int yields = IDLE_SPIN_COUNT)
+    {
+        if(checkRunningState()) return;
+        if(pauses < -1 || yields < 0) return;
+        idleStrategy_ = strategy;
+        idlePauses_ = pauses == -1 ? autoIdlePauses() : pauses;
+        idleYields_ = yields;
+    }
+    //工作线程找不到本池的任务、挂起之前调用work，返回true表示它在这个线程上做了别的事，线程回来重新找任务
+    //线程池组用它把空闲线程借给别的线程池(调用那个线程池的runLentTask())；IDLE_BUSY_POLL的线程一直自旋，不会调用
+    void setIdleWork(std::function<bool()> work)
+    {
+        if(checkRunningState()) return;
+        idleWork_ = std::move(work);
+    }
+    //池外线程提交任务时本池没有空闲线程，在提交线程上调用callback，线程池组用它叫醒别的线程池的空闲线程
+    void setBacklogCallback(std::function<void()> callback)
+    {
+        if(checkRunningState()) return;
+        backlogCallback_ = std::move(callback);
+    }
+    //设置工作线程绑定cpu的方式，cpus只在AFFINITY_EXPLICIT下使用
+    void setAffinity(AffinityPolicy policy, std::vector<int> cpus = {})
+    {
+        if(checkRunningState()) return;
+        affinityPolicy_ = policy;
+        affinityCpus_ = std::move(cpus);
+    }
+    //开启NUMA感知：每个节点一个注入队列，工作线程先取本节点的任务、先窃取同节点的线程，再去其他节点
+    //firstTouch为true时每个节点单独一个共享状态内存池，由该节点的工作线程第一次写入
+    //需要知道每个线程在哪个节点，没有设置亲和性时按AFFINITY_SCATTER绑定，只有一个节点时不建额外的队列
+    void setNumaAware(bool enable, bool firstTouch = false)
+    {
+        if(checkRunningState()) return;
+        numaAware_ = enable;
+        numaFirstTouch_ = enable && firstTouch;
+    }
+    //替换检测到的cpu拓扑，容器里/sys和实际可用的cpu不一致时使用
+    void setTopology(CpuTopology topology)
+    {
+        if(checkRunningState()) return;
+        topology_ = std::move(topology);
+    }
+    //每隔period把一份统计快照交给callback，在单独的线程里调用，线程池析构时停止
+    void setStatsCallback(std::chrono::milliseconds period, std::function<void(const PoolStats&)> callback)
+    {
+        if(checkRunningState()) return;
+        statsPeriod_ = period;
+        statsCallback_ = std::move(callback);
     }
     void setThreadSizeThreshHold(int threshold)
     {
         if(checkRunningState()) return;
         if(poolMode_==PoolMode::MODE_CACHED) threadSizeThreshHold_= threshold;
     }
+    //cached模式的弹性伸缩参数：线程数量范围、采样间隔、排队等待目标、创建速率和空闲缩容时间
+    void setElasticOptions(const ElasticOptions& options)
+    {
+        if(checkRunningState()) return;
+        elasticOptions_ = options;
+    }
     //给线程池提交任务
+    //任务和参数直接存进TaskFunc的内部缓冲区，结果的共享状态来自内存池，小任务提交全程不分配堆内存
     template<typename Func, typename... Args>
-    auto submitTask(Func&& func, Args&&... args) -> std::future<decltype(func(args...))> 
+    auto submitTask(Func&& func, Args&&... args) -> Future<decltype(func(args...))>
     {
         using RType = decltype(func(args...));
-        auto task = std::make_shared<std::packaged_task<RType()>> (
-            std::bind(std::forward<Func>(func), std::forward<Args>(args)...)
-        );
-        std::future<RType> result = task->get_future();
+        Promise<RType> promise(submitStatePool(), this);
+        Future<RType> result = promise.getFuture();
+        Task task = makeTask(std::move(promise), std::forward<Func>(func), std::forward<Args>(args)...);
 
-            //生产者获取锁，任务队列是临界区
-        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        //放入有界任务队列，满了按提交策略处理，失败时future里是异常
+        if(!pushTask(std::move(task)))
+        {
+            tasksRejected_++;
+            setFutureException(result, rejectedError());
+        }
 
-        //线程通信，等待任务队列有空间，size<task_max_threshold,否则条件变量阻塞并释放锁
-        //如果阻塞了一秒钟，返回任务提交失败
-        if(!notFull_.wait_for(lock,std::chrono::seconds(1),
-        [&]()->bool {return taskQue_.size()<(size_t)taskQueMaxThreshHold_ ;}));
-        {
-            std::cerr<<"task queue is full , submit task failed"<<std::endl;
-            //return task->getResult(); //任务成员方法返回任务不可以：task执行完，task对象已经析构了
-            auto task = std::make_shared<std::packaged_task<RType()>>([]()->RType{return RType();});
-            (*task)();
-            return task->get_future(); 
-        }
-        //wait(lock)  wait_for()  wait_until()  等到条件满足  
-        //wait_for返回false，表示等1秒条件依然不满足
-        //如果有空余，把任务放入任务队列
-        taskQue_.emplace([](){(*task)();});
-        taskSize_++; 
-        
-        //提交之后任务队列不为空，通知消费者消费任务，notEmpty_上进行通知
-        notEmpty_.notify_all();
-
-
-        //需要根据任务数量和空闲线程的数量，判断是否需要创建新的线程出来
-        //cached模式任务处理比较紧急，但是场景：小而快的任务，耗时任务不适合cached，因为长时间占用线程会导致线程创建过多
-        //cached模式且任务数量大于空闲线程数量，且当前线程数量少于线程数量上限（根据机器来定）
-        if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_< threadSizeThreshHold_)
-        {
-            //创建新线程
-            //创建线程对象的时候，把线程函数给到thread线程对象
-            auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-            int threadId = ptr->getId();
-            threads_.emplace(threadId, std::move(ptr));
-            threads_[threadId]->start();
-            //修改线程数量相关变量
-            idleThreadSize_++;
-            //unique_ptr无左值的拷贝赋值
-            // threads_.emplace_back(std::move(ptr));
-            curThreadSize_++;
+        return result;
+
+    }
+
+    //按优先级车道提交，工作线程先取高优先级车道，低优先级车道被连续跳过PRIORITY_AGING_LIMIT次后先取一次
+    template<typename Func, typename... Args>
+    auto submitTask(TaskPriority priority, Func&& func, Args&&... args) -> Future<decltype(func(args...))>
+    {
+        if(priority == TaskPriority::PRIORITY_NORMAL)
+        {
+            return submitTask(std::forward<Func>(func), std::forward<Args>(args)...);
+        }
+
+        using RType = decltype(func(args...));
+        Promise<RType> promise(submitStatePool(), this);
+        Future<RType> result = promise.getFuture();
+        Task task = makeTask(std::move(promise), std::forward<Func>(func), std::forward<Args>(args)...);
+
+        ensureLanes();
+        MpmcQueue<Task>& que = priority == TaskPriority::PRIORITY_HIGH ? *highQue_ : *lowQue_;
+        task.setStamp(statsNowNs());
+        if(!acceptingTasks() || (!que.tryPush(std::move(task)) && !waitForSlot(que, task)))
+        {
+            tasksRejected_++;
+            setFutureException(result, rejectedError());
+            return result;
+        }
+        taskSize_++;
+        notifyWorker();
+        growIfNeeded();
+        notifyBacklog();
+        return result;
+    }
+
+    //带截止时间提交，进入最早截止时间优先(EDF)车道，它先于所有优先级车道
+    //截止时间已过的任务不会执行，future直接得到异常
+    template<typename Func, typename... Args>
+    auto submitTask(std::chrono::steady_clock::time_point deadline, Func&& func, Args&&... args)
+        -> Future<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        Promise<RType> promise(submitStatePool(), this);
+        Future<RType> result = promise.getFuture();
+        if(std::chrono::steady_clock::now() >= deadline)
+        {
+            tasksExpired_++;
+            setFutureException(result, deadlineExpiredError());
+            return result;
+        }
+
+        DeadlineTask entry;
+        entry.deadline = deadline;
+        entry.state = FutureAccess::state(result);
+        entry.task = makeTask(std::move(promise), std::forward<Func>(func), std::forward<Args>(args)...);
+        entry.task.setStamp(statsNowNs());
+        {
+            std::lock_guard<std::mutex> lock(edfMtx_);
+            if(!acceptingTasks() || (int)edfHeap_.size() >= taskQueMaxThreshHold_)
+            {
+                //截止时间车道不等待空位，满了直接失败
+                tasksRejected_++;
+                entry.state->trySetException(rejectedError());
+                return result;
+            }
+            entry.seq = edfSeq_++;
+            edfHeap_.push_back(std::move(entry));
+            std::push_heap(edfHeap_.begin(), edfHeap_.end(), DeadlineLater());
+            edfSize_.store((int)edfHeap_.size(), std::memory_order_relaxed);
         }
-        
+        taskSize_++;
+        notifyWorker();
+        growIfNeeded();
+        notifyBacklog();
         return result;
+    }
 
+    //按key串行提交：key散列到KEYED_STRAND_COUNT个strand中的一个，同一个key的任务按提交顺序一个接一个执行，不同key之间并行
+    //例如按连接id、账户id提交，不需要再用互斥锁保护每个key的数据，也不会有工作线程阻塞在这些锁上
+    //不同的key可能落在同一个strand上互相排队；任务里不要等待同一个key后面的任务
+    template<typename Key, typename Func, typename... Args>
+    auto submitKeyed(const Key& key, Func&& func, Args&&... args) -> Future<decltype(func(args...))>
+    {
+        //std::hash对整数是恒等映射，再混合一次，连续的id分散到不同的strand
+        uint64_t h = (uint64_t)std::hash<Key>()(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return ensureKeyedStrands()[h % KEYED_STRAND_COUNT].submitTask(std::forward<Func>(func), std::forward<Args>(args)...);
     }
 
-    bool checkRunningState()const{
-        return isPoolRunning_;
+    //在取消作用域下提交：source.cancel()时还没开始执行的任务不再执行，future得到TaskCancelledError
+    //已经在运行的任务不会被打断，通过token或CancellationToken::current()轮询isCancelled()自己提前返回
+    template<typename Func, typename... Args>
+    auto submitTask(CancellationToken token, Func&& func, Args&&... args) -> Future<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        Promise<RType> promise(submitStatePool(), this);
+        Future<RType> result = promise.getFuture();
+        if(!token.track(FutureAccess::state(result)))
+        {
+            FutureAccess::state(result)->tryCancel();
+            return result;
+        }
+
+        Task task([promise = std::move(promise), token = std::move(token),
+            func = std::forward<Func>(func),
+            args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        {
+            CancellationScope scope(token);
+            promise.setFromCall([&]()->RType{ return std::apply(func, args); });
+        });
+        if(!pushTask(std::move(task)))
+        {
+            tasksRejected_++;
+            setFutureException(result, rejectedError());
+        }
+        return result;
     }
 
+    //批量提交[begin, end)中的无参可调用对象，整批一次预留队列空位、一次唤醒
+    template<typename Iter>
+    auto submitBatch(Iter begin, Iter end) -> std::vector<Future<decltype((*begin)())>>
+    {
+        using RType = decltype((*begin)());
+        std::vector<Task> tasks;
+        std::vector<Future<RType>> results;
+        for(; begin != end; ++begin)
+        {
+            Promise<RType> promise(submitStatePool(), this);
+            results.emplace_back(promise.getFuture());
+            tasks.emplace_back([promise = std::move(promise), func = *begin]() mutable
+            {
+                promise.setFromCall(func);
+            });
+        }
+        submitTasks(tasks, results);
+        return results;
+    }
 
-    ThreadPool(const ThreadPool&) = delete;
-    ThreadPool& operator=(const ThreadPool&) = delete;
-private:
-    //定义线程函数
-    void threadFunc(int threadid)
-    {
-        auto lastTime = std::chrono::high_resolution_clock().now();
-    // std::cout<<"begin threadFunc tid:"<<std::this_thread::get_id()
-    // <<std::endl;
-    // std::cout<<"end threadFunc tid:"<<std::this_thread::get_id()
-        // <<std::endl;
-        for(;;)
+    //批量提交n个任务，第i个任务执行func(i)
+    template<typename Func>
+    auto submitBulk(size_t n, Func&& func) -> std::vector<Future<decltype(func(size_t(0)))>>
+    {
+        using RType = decltype(func(size_t(0)));
+        std::vector<Task> tasks;
+        std::vector<Future<RType>> results;
+        tasks.reserve(n);
+        results.reserve(n);
+        for(size_t i = 0; i < n; i++)
         {
-            Task task;
+            Promise<RType> promise(submitStatePool(), this);
+            results.emplace_back(promise.getFuture());
+            tasks.emplace_back([promise = std::move(promise), func, i]() mutable
             {
-                    //先获取锁
-                std::unique_lock<std::mutex> lock(taskQue_);
-                std::cout<< "tid:" <<std::this_thread::get_id()
-                << "尝试获取任务" <<std::endl;
+                promise.setFromCall([&]()->RType{ return func(i); });
+            });
+        }
+        submitTasks(tasks, results);
+        return results;
+    }
 
-                //cached模式下， 有可能已经创建了很多的线程，但是空闲时间超过60s应该回收多余的线程
-                //超过initThreadsize的数量需要进行回收
-                //当前时间  上一次线程执行时间如果间隔60s,
-                //锁加双重判断
-                while(taskQue_.size() == 0) //修改过后只有无任务执行的时候才判断线程池是否析构
-                {
-                    if(!isPoolRunning_)
-                    {
-                        threads_.erase(threadid);  //std::this_thread::getid()
-                        std::cout<<"threadid:"<<std::this_thread::get_id()<<"exit"<<std::endl;
-                        exitCond_.notify_all();
-                        return;
-                    }
-
-                    if(poolMode_ == PoolMode::MODE_CACHED)
-                    {
-                        //cached模式下线程空闲超过一定时间则释放
-                        if( std::cv_status::timeout == notEmpty_.wait_for(lock, std::chrono::seconds(1)))
-                        {
-                            auto now = std::chrono::high_resolution_clock().now();
-                            auto dur = std::chrono::duration_cast<std::chrono::seconds>(now - lastTime);
-                            if(dur.count() >= THREAD_MAX_IDLE_TIME 
-                            && curThreadSize_ > initThreadSize_)
-                            {
-                                //回收当前线程
-                                //线程数量相关变量的修改
-                                //把线程对象从线程列表容器中删除 通过线程id
-                                threads_.erase(threadid);  //std::this_thread::getid()
-                                curThreadSize_--;
-                                idleThreadSize_--;
-                                std::cout<<"threadid:"<<std::this_thread::get_id()<<"exit"<<std::endl;
-                                return;
-                                
-                            }
-                        }
-                    }
-                    else
-                    {
-                        //等待notEmpty条件
-                        notEmpty_.wait(lock);
-                    }
-                    //检查一下有任务被唤醒还是线程池结束被唤醒
-                    // if(!isPoolRunning_)
-                    // {
-                    //     threads_.erase(threadid);  //std::this_thread::getid()
-                    //     std::cout<<"threadid:"<<std::this_thread::get_id()<<"exit"<<std::endl;
-                    //     exitCond_.notify_all();
-                    //     return;
-                    // }
-                }
-                
+    //delay之后把任务提交到线程池，返回的future在到期前可以cancel()
+    //到期的任务和submitTask一样进入任务队列，队列满被拒绝时future得到broken_promise
+    template<typename Rep, typename Period, typename Func, typename... Args>
+    auto submitAfter(const std::chrono::duration<Rep, Period>& delay, Func&& func, Args&&... args)
+        -> ScheduledFuture<decltype(func(args...))>
+    {
+        return submitAt(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay),
+            std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //到when时提交，精度是时间轮的一格(1ms)，不会提前
+    template<typename Func, typename... Args>
+    auto submitAt(std::chrono::steady_clock::time_point when, Func&& func, Args&&... args)
+        -> ScheduledFuture<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        Promise<RType> promise(submitStatePool(), this);
+        Future<RType> result = promise.getFuture();
+        if(shutdown_)
+        {
+            setFutureException(result, rejectedError());
+            return ScheduledFuture<RType>(std::move(result), TimerHandle());
+        }
+        TimerWheel& wheel = ensureTimers();
+        uint64_t id = wheel.add(when, makeTask(std::move(promise), std::forward<Func>(func), std::forward<Args>(args)...));
+        wakeTimer(when);
+        return ScheduledFuture<RType>(std::move(result), TimerHandle(timers_, id));
+    }
 
-                //从wait返回
-                idleThreadSize_--;
+    //每隔period提交一次，第一次在period之后，返回值被忽略
+    //上一次还没执行完时跳过这一次；抛出异常后不再触发；用返回的句柄cancel()停止
+    template<typename Rep, typename Period, typename Func, typename... Args>
+    TimerHandle submitEvery(const std::chrono::duration<Rep, Period>& period, Func&& func, Args&&... args)
+    {
+        auto interval = std::chrono::duration_cast<std::chrono::nanoseconds>(period);
+        auto first = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+        if(shutdown_) return TimerHandle();
+        TimerWheel& wheel = ensureTimers();
+        uint64_t id = wheel.add(first, Task([func = std::forward<Func>(func),
+            args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        {
+            std::apply(func, args);
+        }), interval);
+        wakeTimer(first);
+        return TimerHandle(timers_, id);
+    }
 
-                std::cout<< "tid:" <<std::this_thread::get_id()
-                <<  "获取任务成功......" <<std::endl;
-                //从任务队列中取一个任务出来
-                auto task = taskQue_.front();
-                taskQue_.pop();
-                taskSize_--;
-                
-                //访问临界区结束，应该释放锁
-                lock.unlock(); 
-                
-                //如果依然有剩余任务，继续通知其他线程执行任务
-                if(taskQue_.size() > 0)
-                {
-                    notEmpty_.notify_all();
-                }
+    //阻塞区域的RAII守卫：池内线程在它的生命周期内被当作阻塞，线程池临时补充一个线程，析构时让多出来的线程退出
+    //类似ForkJoinPool.managedBlock，池外线程或者嵌套的内层守卫什么都不做
+    class BlockingRegion
+    {
+    public:
+        BlockingRegion(BlockingRegion&& other) noexcept
+            :pool_(other.pool_)
+        {
+            other.pool_ = nullptr;
+        }
+        BlockingRegion(const BlockingRegion&) = delete;
+        BlockingRegion& operator=(const BlockingRegion&) = delete;
+        BlockingRegion& operator=(BlockingRegion&&) = delete;
 
-                //取出一个任务，进行通知，通知可以继续提交生产任务
-                notFull_.notify_all();   
-                
-                //当前线程负责执行这个任务
-                if(task!= nullptr)
-                {
-                    task(); //执行function<void()>
-                }
-                lastTime = std::chrono::high_resolution_clock().now();//更新线程执行完任务的时间
+        ~BlockingRegion()
+        {
+            if(pool_ != nullptr && --currentWorker().blockingDepth == 0)
+            {
+                pool_->leaveBlocking();
+            }
+        }
 
-                //任务处理结束空闲线程++
-                idleThreadSize_++;
+    private:
+        friend class ThreadPool;
+        explicit BlockingRegion(ThreadPool* pool)
+            :pool_(pool)
+        {
+            if(pool_ != nullptr && currentWorker().blockingDepth++ == 0)
+            {
+                pool_->enterBlocking();
             }
-            
-        }   
+        }
+
+        ThreadPool* pool_; //当前线程是这个线程池的工作线程时非空
+    };
+
+    //在任务里包住阻塞的调用(磁盘读写、sleep、等待锁等)：
+    //  auto guard = pool.blockingRegion();
+    BlockingRegion blockingRegion()
+    {
+        return BlockingRegion(currentWorker().pool == this ? this : nullptr);
     }
 
-private:
-    // std::vector<std::unique_ptr<Thread>> threads_;//线程列表
-    std::unordered_map<int, std::unique_ptr<Thread>> threads_; //线程列表
-    size_t initThreadSize_;  //初始的线程数量
-    int threadSizeThreshHold_; //线程数量上限
-    std::atomic_int  idleThreadSize_; //空闲线程的数量
-    std::atomic_int curThreadSize_;//当前线程总数 vec.size()不是线程安全的
+    //提交一个会阻塞的任务，整个任务运行在阻塞区域里
+    template<typename Func, typename... Args>
+    auto submitBlocking(Func&& func, Args&&... args) -> Future<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        return submitTask([this, func = std::forward<Func>(func),
+            args = std::make_tuple(std::forward<Args>(args)...)]() mutable -> RType
+        {
+            BlockingRegion guard = blockingRegion();
+            return std::apply(func, args);
+        });
+    }
 
+    //co_await pool.schedule()：协程挂起，在线程池的工作线程上恢复执行，协程类型CoTask和sync_wait见coroutine.h
+    //await_suspend是模板，这个头文件不依赖<coroutine>，C++17下也能编译
+    class ScheduleAwaiter
+    {
+    public:
+        bool await_ready() const noexcept { return false; }
 
-    using Task = std::function<void()>;
-    //需要保证任务对象声明周期，调用run之后才析构
-    std::queue<Task> taskQue_;//任务队列
-    std::atomic_int  taskSize_;   //任务的数量
-    int taskQueMaxThreshHold_;  //任务队列数量上限阈值
-     
-    std::mutex taskQueMtx_; //保证任务队列的线程安全
-    std::condition_variable notFull_; //任务队列不满
-    std::condition_variable notEmpty_; //任务队列不空
-    std::condition_variable exitCond_; //等待线程资源全部回收
-    
+        //按提交策略放进队列，放不进去(拒绝、超时或线程池已经停止)返回false，协程在当前线程继续执行
+        template<typename Handle>
+        bool await_suspend(Handle handle)
+        {
+            return pool_->isPoolRunning_ && pool_->pushTask(Task([handle]() mutable { handle.resume(); }));
+        }
+
+        void await_resume() const noexcept {}
+
+    private:
+        friend class ThreadPool;
+        explicit ScheduleAwaiter(ThreadPool* pool) : pool_(pool) {}
+
+        ThreadPool* pool_;
+    };
+
+    ScheduleAwaiter schedule()
+    {
+        return ScheduleAwaiter(this);
+    }
+
+    //当前线程所属的线程池，池外线程返回nullptr
+    static ThreadPool* current()
+    {
+        return currentWorker().pool;
+    }
+
+    //当前工作线程的任务内存区：分配只移动指针、不加锁，deallocate不做事，任务返回后整体回收
+    //适合任务内部短命的临时缓冲区，例如std::pmr::vector<char> buf(ThreadPool::currentArena())
+    //内存不能放进任务结果，也不能跨co_await保存；池外线程返回std::pmr::get_default_resource()
+    static std::pmr::memory_resource* currentArena()
+    {
+        TaskArena* arena = currentWorker().arena;
+        return arena != nullptr ? static_cast<std::pmr::memory_resource*>(arena) : std::pmr::get_default_resource();
+    }
+
+    //任务共享状态的内存池，开启NUMA感知时是提交线程所在节点的，协程帧也从这里分配
+    StatePool* memoryPool() const
+    {
+        return submitStatePool();
+    }
+
+    bool checkRunningState()const{
+        return isPoolRunning_;
+    }
+
+    //当前线程数量，并行算法按它计算自动粒度
+    int threadCount()const{
+        return curThreadSize_;
+    }
+
+    //空闲线程数量和排队的任务数量，不加锁的近似值，线程池组按它们决定是否借出线程
+    int idleThreadCount()const{
+        return idleThreadSize_;
+    }
+    int queuedTasks()const{
+        return std::max(0, taskSize_.load(std::memory_order_relaxed));
+    }
+
+    //在别的线程池借出的空闲线程上执行本池的一个排队任务，没有任务或者已经关闭时返回false
+    //执行期间线程换成本池的池外线程身份：ThreadPool::current()是本池，窃取和执行计入本池的统计，
+    //任务里等待future时帮本池执行任务；currentArena()仍是借出线程的内存区，借出方在任务返回后回收
+    //调用者要保证本池对象在调用期间还在(线程池组同时拥有两边的线程池)；关闭会等借出线程上的任务执行完
+    bool runLentTask()
+    {
+        if(taskSize_.load(std::memory_order_relaxed) <= 0) return false;
+        {
+            //和shutdownUntil在同一把锁下检查：要么关闭等这个线程回来，要么这里看到已经停止
+            std::lock_guard<std::mutex> lock(taskQueMtx_);
+            if(shutdown_ || !isPoolRunning_) return false;
+            lentActive_++;
+        }
+        bool ran = false;
+        {
+            LentWorkerScope scope(this);
+            WorkerContext& ctx = currentWorker();
+            Task task;
+            if(findTask(-1, 0, *ctx.rng, task))
+            {
+                taskSize_--;
+                if(taskSize_ > 0)
+                {
+                    idleLot_.notifyOne();
+                }
+                tasksBorrowed_++;
+                CancellationScope cancelScope(shutdownSource_.token());
+                runTask(task, ctx.stats, false);
+                ran = true;
+            }
+        }
+        //在锁内减少，关闭线程在锁内看到0以后这个线程不会再访问线程池
+        std::lock_guard<std::mutex> lock(taskQueMtx_);
+        if(--lentActive_ == 0 && shutdown_) exitCond_.notify_all();
+        return ran;
+    }
+
+    //叫醒一个挂起的工作线程，它会先找本池的任务，再通过setIdleWork设置的函数帮别的线程池；没有挂起的线程返回false
+    bool wakeIdleWorker()
+    {
+        if(idleLot_.parked() == 0) return false;
+        return idleLot_.wake(1) > 0;
+    }
+
+    //汇总所有工作线程的计数器，不会阻塞工作线程，各项之间不是同一时刻的精确快照
+    PoolStats stats()
+    {
+        PoolStats result;
+        result.threads = curThreadSize_;
+        result.idleThreads = idleThreadSize_;
+        result.queuedTasks = std::max(0, taskSize_.load());
+        result.blockedThreads = blockedWorkers_;
+        result.spareThreads = spareWorkers_;
+        result.tasksRejected = tasksRejected_;
+        result.tasksExpired = tasksExpired_;
+        result.tasksBorrowed = tasksBorrowed_;
+        result.threadsCreated = threadsCreated_;
+        result.threadsReclaimed = threadsReclaimed_;
+        std::lock_guard<std::mutex> lock(statsMtx_);
+        for(auto& worker : workerStats_)
+        {
+            worker->mergeInto(result);
+        }
+        return result;
+    }
+
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+private:
+    using Task = TaskFunc;
+
+    //截止时间车道里的任务，state用来在过期时让future失败
+    struct DeadlineTask
+    {
+        std::chrono::steady_clock::time_point deadline;
+        uint64_t seq; //截止时间相同时先提交的先执行
+        Task task;
+        FutureStateBase* state;
+    };
+
+    //std::push_heap是大顶堆，截止时间晚的"更小"，堆顶是最早截止的任务
+    struct DeadlineLater
+    {
+        bool operator()(const DeadlineTask& a, const DeadlineTask& b) const
+        {
+            if(a.deadline != b.deadline) return a.deadline > b.deadline;
+            return a.seq > b.seq;
+        }
+    };
+
+    //任务和参数直接存进TaskFunc的内部缓冲区
+    template<typename RType, typename Func, typename... Args>
+    static Task makeTask(Promise<RType>&& promise, Func&& func, Args&&... args)
+    {
+        return Task([promise = std::move(promise),
+            func = std::forward<Func>(func),
+            args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        {
+            promise.setFromCall([&]()->RType{ return std::apply(func, args); });
+        });
+    }
+
+    bool shutdownUntil(ShutdownMode mode, std::chrono::steady_clock::time_point deadline)
+    {
+        if(currentWorker().pool == this)
+        {
+            throw std::logic_error("thread pool cannot be shut down from its own worker thread");
+        }
+        std::lock_guard<std::mutex> guard(shutdownMtx_);
+        if(shutdown_) return true;
+        shutdown_ = true;
+
+        //先停掉统计回调线程、弹性控制器线程和定时线程，它们还在读stats()、创建线程、提交任务
+        stopHelpers();
+        stopTimers();
+        if(mode == ShutdownMode::SHUTDOWN_CANCEL)
+        {
+            cancelPendingTasks();
+        }
+
+        //工作线程取不到任务又看到isPoolRunning_为false时退出，退出前把自己移到retired_
+        bool drained = true;
+        auto allExited = [this]()->bool{ return threads_.empty() && lentActive_ == 0; };
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        isPoolRunning_ = false;
+        idleLot_.wakeAll();
+        notFull_.notify_all();
+        if(deadline != std::chrono::steady_clock::time_point::max() && !exitCond_.wait_until(lock, deadline, allExited))
+        {
+            drained = false;
+            lock.unlock();
+            cancelPendingTasks();
+            lock.lock();
+        }
+        exitCond_.wait(lock, allExited);
+        std::vector<std::unique_ptr<Thread>> exited;
+        exited.swap(retired_);
+        lock.unlock();
+        for(auto& thread : exited)
+        {
+            thread->join();
+        }
+
+        //之后完成的future(包括线程池销毁后)不再把then()和co_await的后续任务交给线程池，在完成它的线程里直接执行
+        invalidateHandle();
+
+        //提交者在关闭前通过了检查、在工作线程退出后才放进队列的任务，在当前线程按同样的方式处理
+        runLeftoverTasks();
+        return drained;
+    }
+
+    void stopHelpers()
+    {
+        if(statsThread_.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(statsMtx_);
+                statsStop_ = true;
+            }
+            statsCond_.notify_all();
+            statsThread_.join();
+        }
+        if(elasticThread_.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(elasticMtx_);
+                elasticStop_ = true;
+            }
+            elasticCond_.notify_all();
+            elasticThread_.join();
+        }
+    }
+
+    //停掉定时线程，还没到期的定时任务作废，future得到TaskCancelledError，周期任务停止
+    void stopTimers()
+    {
+        if(timerThread_.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(timerMtx_);
+                timerStop_ = true;
+            }
+            timerCond_.notify_all();
+            timerThread_.join();
+        }
+        if(timers_)
+        {
+            std::vector<Task> dropped;
+            timers_->clear(dropped);
+            for(Task& task : dropped)
+            {
+                runCancelled(task);
+            }
+        }
+    }
+
+    //之后取出的任务不再执行，正在运行的任务通过CancellationToken::current()看到取消
+    void cancelPendingTasks()
+    {
+        cancelPending_ = true;
+        shutdownSource_.cancel();
+        idleLot_.wakeAll();
+    }
+
+    void runLeftoverTasks()
+    {
+        std::minstd_rand rng(0);
+        WorkerStats* stats = acquireStats();
+        Task task;
+        while(findTask(-1, 0, rng, task))
+        {
+            taskSize_--;
+            runTask(task, stats, false);
+        }
+        releaseStats(stats);
+    }
+
+    //在futureCancelCalls()下执行任务：产生结果的任务不调用用户函数，future得到TaskCancelledError
+    //没有结果的任务(协程的恢复)照常执行，协程之后的提交会失败
+    static void runCancelled(Task& task)
+    {
+        bool& cancel = futureCancelCalls();
+        bool saved = cancel;
+        cancel = true;
+        task();
+        cancel = saved;
+    }
+
+    //关闭之后只接受本线程池工作线程的提交(排空时任务产生的子任务)，池外线程的提交被拒绝
+    bool acceptingTasks() const
+    {
+        return !shutdown_.load(std::memory_order_acquire) || currentWorker().pool == this;
+    }
+
+    //submitKeyed第一次使用时才创建strand
+    std::vector<Strand>& ensureKeyedStrands()
+    {
+        std::call_once(keyedOnce_, [this]()
+        {
+            keyedStrands_.reserve(KEYED_STRAND_COUNT);
+            for(int i = 0; i < KEYED_STRAND_COUNT; i++)
+            {
+                keyedStrands_.emplace_back(*this, statePool_);
+            }
+        });
+        return keyedStrands_;
+    }
+
+    //高/低优先级车道第一次使用时才创建，不用优先级的线程池不占这部分内存
+    void ensureLanes()
+    {
+        std::call_once(lanesOnce_, [this]()
+        {
+            highQue_ = std::make_unique<MpmcQueue<Task>>(taskQueMaxThreshHold_);
+            lowQue_ = std::make_unique<MpmcQueue<Task>>(taskQueMaxThreshHold_);
+            lanesInUse_.store(true, std::memory_order_release);
+        });
+    }
+
+    //时间轮和定时线程第一次提交定时任务时才创建
+    TimerWheel& ensureTimers()
+    {
+        std::call_once(timersOnce_, [this]()
+        {
+            timers_ = std::make_shared<TimerWheel>();
+            timerThread_ = std::thread([this](){ timerLoop(); });
+        });
+        return *timers_;
+    }
+
+    //新定时器比定时线程计划醒来的时间早时唤醒它重新计算
+    void wakeTimer(std::chrono::steady_clock::time_point when)
+    {
+        std::lock_guard<std::mutex> lock(timerMtx_);
+        if(when < timerWake_)
+        {
+            timerWake_ = when;
+            timerCond_.notify_one();
+        }
+    }
+
+    //定时线程：睡到时间轮下一次有事可做，把到期的任务放进任务队列
+    void timerLoop()
+    {
+        std::vector<Task> due;
+        std::unique_lock<std::mutex> lock(timerMtx_);
+        while(!timerStop_)
+        {
+            auto now = std::chrono::steady_clock::now();
+            timerWake_ = timers_->nextWakeup();
+            if(timerWake_ > now)
+            {
+                if(timerWake_ == std::chrono::steady_clock::time_point::max())
+                {
+                    timerCond_.wait(lock);
+                }
+                else
+                {
+                    timerCond_.wait_until(lock, timerWake_);
+                }
+                continue;
+            }
+            lock.unlock();
+            timers_->advance(now, due);
+            for(Task& task : due)
+            {
+                //定时线程不等队列空位，否则队列满时后面到期的定时器都会推迟
+                //被拒绝的任务在下面clear时析构，它的future得到broken_promise
+                if(!pushTask(std::move(task), false)) tasksRejected_++;
+            }
+            due.clear();
+            lock.lock();
+        }
+    }
+
+    //后续任务由完成前驱的线程触发，不能阻塞它：队列满或线程池已经停止时直接在当前线程执行
+    void execute(TaskFunc&& task) override
+    {
+        if(!isPoolRunning_ || !pushTask(std::move(task), false))
+        {
+            task();
+        }
+    }
+
+    //在阻塞区域里不帮忙，阻塞区域已经补偿了线程，这个线程应该尽快回到阻塞操作上
+    bool canHelp() override
+    {
+        WorkerContext& ctx = currentWorker();
+        return ctx.pool == this && ctx.blockingDepth == 0;
+    }
+
+    //池内线程在future上等待时执行一个任务：和工作线程找任务的顺序一样，先取自己本地队列里刚提交的子任务
+    bool helpOne() override
+    {
+        WorkerContext& ctx = currentWorker();
+        Task task;
+        if(!findTask(ctx.index, ctx.node, *ctx.rng, task)) return false;
+        taskSize_--;
+        if(taskSize_ > 0)
+        {
+            idleLot_.notifyOne();
+        }
+        //外层任务从内存区分配的内存还在用，只回收嵌套任务自己分配的
+        if(ctx.arena == nullptr)
+        {
+            runTask(task, ctx.stats, true);
+            return true;
+        }
+        TaskArena::Mark mark = ctx.arena->mark();
+        runTask(task, ctx.stats, true);
+        ctx.arena->rewind(mark);
+        return true;
+    }
+
+    //嵌套太深只能挂起等待时，当作阻塞区域补充线程
+    void enterWait() override
+    {
+        if(currentWorker().blockingDepth++ == 0) enterBlocking();
+    }
+
+    void leaveWait() override
+    {
+        if(--currentWorker().blockingDepth == 0) leaveBlocking();
+    }
+
+    //执行一个任务，前后各取一次时间，统计排队和执行时间
+    //nested表示在等待future时帮忙执行的任务，返回值是执行开始的时间
+    uint64_t runTask(Task& task, WorkerStats* stats, bool nested)
+    {
+        uint64_t runBegin = statsNowNs();
+        if(task!= nullptr)
+        {
+            if(cancelPending_.load(std::memory_order_relaxed))
+            {
+                runCancelled(task);
+            }
+            else
+            {
+                task(); //执行function<void()>
+            }
+        }
+        uint64_t runEnd = statsNowNs();
+        uint64_t stamp = task.stamp();
+        stats->recordTask(stamp != 0 && runBegin > stamp ? runBegin - stamp : 0, runEnd - runBegin, nested);
+        return runBegin;
+    }
+
+    //工作窃取模式下本地队列里存放的任务节点，执行完还给分配它的线程复用
+    struct TaskNode
+    {
+        Task task;
+        TaskNode* next = nullptr;
+        int owner = -1; //分配这个节点的工作线程
+    };
+    //head/chunks/capacity只被对应的工作线程访问，被窃取执行的节点由窃取者无锁压入remoteFree
+    //节点按块分配，只增不减，稳定后节点数不超过这个线程同时在队列里的任务数最高值的两倍
+    struct alignas(64) NodeCache
+    {
+        TaskNode* head = nullptr;
+        std::atomic<TaskNode*> remoteFree{nullptr};
+        std::vector<std::unique_ptr<TaskNode[]>> chunks;
+        int capacity = 0;
+    };
+    //DEQUEUE_BATCH下一个工作线程的批队列，que只在第一次用到时写一次，inUse由statsMtx_保护
+    struct BatchSlot
+    {
+        std::atomic<MpmcQueue<Task>*> que{nullptr};
+        bool inUse = false;
+    };
+
+    //记录当前线程属于哪个线程池的第几个工作线程，池外线程index为-1
+    struct WorkerContext
+    {
+        ThreadPool* pool = nullptr;
+        int index = -1;
+        int node = 0; //所在的NUMA节点，没有开启NUMA感知时为0
+        int shardCursor = 0; //注入队列分片时下一次先看的分片
+        WorkerStats* stats = nullptr; //本线程的计数器
+        int blockingDepth = 0; //嵌套的阻塞区域层数，只有最外层计数
+        std::minstd_rand* rng = nullptr; //窃取时选择目标的随机数，等待future时帮忙执行任务也用它
+        TaskArena* arena = nullptr; //本线程的任务内存区，每个任务返回后回收
+        MpmcQueue<Task>* batchQue = nullptr; //DEQUEUE_BATCH下本线程取出的一批任务，没有分到槽位时为空
+    };
+    static WorkerContext& currentWorker()
+    {
+        static thread_local WorkerContext ctx;
+        return ctx;
+    }
+
+    //借出线程执行本池任务期间的线程身份，析构时换回借出方的，计数器还给本池
+    class LentWorkerScope
+    {
+    public:
+        explicit LentWorkerScope(ThreadPool* pool)
+            :pool_(pool)
+            ,saved_(currentWorker())
+            ,savedHelper_(currentFutureHelper())
+            ,rng_(saved_.rng != nullptr ? (*saved_.rng)() : 1)
+        {
+            WorkerContext& ctx = currentWorker();
+            ctx = WorkerContext();
+            ctx.pool = pool;
+            ctx.shardCursor = saved_.shardCursor;
+            ctx.stats = pool->acquireStats();
+            ctx.rng = &rng_;
+            ctx.arena = saved_.arena;
+            currentFutureHelper() = pool;
+        }
+
+        ~LentWorkerScope()
+        {
+            pool_->releaseStats(currentWorker().stats);
+            currentWorker() = saved_;
+            currentFutureHelper() = savedHelper_;
+        }
+
+        LentWorkerScope(const LentWorkerScope&) = delete;
+        LentWorkerScope& operator=(const LentWorkerScope&) = delete;
+
+    private:
+        ThreadPool* pool_;
+        WorkerContext saved_;
+        FutureHelper* savedHelper_;
+        std::minstd_rand rng_;
+    };
+
+    //定义线程函数，index是工作窃取模式下本地队列的下标，其他模式为-1
+    void threadFunc(int threadid, int index)
+    {
+        WorkerContext& ctx = currentWorker();
+        ctx.pool = this;
+        ctx.index = index;
+        //工作窃取模式下第i个线程用第i个位置，其他模式按启动顺序
+        ctx.node = placeWorker(index >= 0 ? index : placementSeq_++);
+        ctx.shardCursor = threadid; //各线程从不同的分片开始
+        int node = ctx.node;
+        std::minstd_rand rng(threadid + 1);
+        ctx.rng = &rng;
+        TaskArena arena;
+        ctx.arena = &arena;
+        currentFutureHelper() = this;
+        Parker parker; //本线程的停车位，挂起时登记到idleLot_
+        WorkerStats* stats = acquireStats(); //本线程的计数器，只有本线程写
+        CancellationScope shutdownScope(shutdownSource_.token()); //没有带token的任务看到的是线程池关闭的取消
+        ctx.stats = stats;
+        //DEQUEUE_BATCH下第一个任务之外再取出的任务放进本线程的批队列，等待future时帮忙执行的线程和空闲线程也能拿走
+        MpmcQueue<Task>* batchQue = acquireBatchQue();
+        ctx.batchQue = batchQue;
+        std::vector<Task> batch(batchQue != nullptr ? batchMax_ - 1 : 0);
+        if(index < 0)
+        {
+            //没有本地队列的线程可以在阻塞区域结束后退出
+            std::lock_guard<std::mutex> lock(spareMtx_);
+            retirable_.push_back(&parker);
+        }
+        for(;;)
+        {
+            Task task;
+            bool found = findTask(index, node, rng, task);
+            uint64_t idleBegin = 0;
+            if(!found)
+            {
+                idleBegin = statsNowNs();
+                if(idleStrategy_ != IdleStrategy::IDLE_BLOCK)
+                {
+                    //先自旋一会儿，有线程在自旋时提交者不会去唤醒挂起的线程
+                    idleLot_.beginSpin();
+                    found = spinForTask(index, node, rng, task);
+                    idleLot_.endSpin();
+                    if(found) WorkerStats::add(stats->spinHits, 1);
+                }
+            }
+
+            //IDLE_BUSY_POLL的线程不挂起，缩容和补偿线程的退出在自旋结束后检查
+            if(!found && idleStrategy_ == IdleStrategy::IDLE_BUSY_POLL && isPoolRunning_
+                && ((poolMode_ == PoolMode::MODE_CACHED && takeRetireToken()) || (index < 0 && retireSpare())))
+            {
+                WorkerStats::add(stats->idleNs, statsNowNs() - idleBegin);
+                reclaimWorker(threadid, stats, &parker);
+                return;
+            }
+
+            //挂起之前先看别的线程池要不要借用这个线程，帮它执行了一个任务就回来重新找
+            if(!found && lendIdle(arena))
+            {
+                WorkerStats::add(stats->idleNs, statsNowNs() - idleBegin);
+                continue;
+            }
+
+            //挂起直到取到任务；cached模式的多余线程由弹性控制器发放退出名额、唤醒后在下面退出，不按空闲时间回收
+            while(!found)
+            {
+                //先登记再检查一次队列，和提交者"先放任务再看登记表"配对，不会丢失唤醒
+                idleLot_.enroll(&parker);
+                found = findTask(index, node, rng, task);
+                if(found || !isPoolRunning_)
+                {
+                    //已经被提交者取出的话唤醒正在路上，把令牌消耗掉
+                    if(!idleLot_.cancel(&parker)) parker.park();
+                    if(found) break;
+
+                    unregisterRetirable(&parker);
+                    releaseStats(stats);
+                    releaseBatchQue(batchQue);
+                    std::unique_lock<std::mutex> lock(taskQueMtx_);
+                    retireThread(threadid);
+                    ctx = WorkerContext();
+                    currentFutureHelper() = nullptr;
+                    return;
+                }
+
+                //挂起等待提交者单独唤醒，不再定时醒来检查空闲时间
+                WorkerStats::add(stats->parks, 1);
+                parker.park();
+                found = findTask(index, node, rng, task);
+
+                //cached模式下弹性控制器缩容时发放退出名额并唤醒挂起最久的线程，醒来没有任务的线程领一个名额退出
+                //阻塞区域结束后多出来的补偿线程也在这里退出
+                if(!found && ((poolMode_ == PoolMode::MODE_CACHED && takeRetireToken())
+                    || (index < 0 && retireSpare())))
+                {
+                    WorkerStats::add(stats->idleNs, statsNowNs() - idleBegin);
+                    reclaimWorker(threadid, stats, &parker);
+                    return;
+                }
+
+                //被借用线程的线程池叫醒的
+                if(!found && lendIdle(arena)) break;
+            }
+            if(!found)
+            {
+                WorkerStats::add(stats->idleNs, statsNowNs() - idleBegin);
+                continue;
+            }
+
+            //取到任务，批量模式下再从注入队列多取几个，下面的计数和唤醒整批只做一次
+            idleThreadSize_--;
+            int batched = batch.empty() ? 0 : fillBatch(node, batch, batchQue);
+            taskSize_ -= 1 + batched;
+
+            //如果依然有剩余任务并且没有线程在自旋，再唤醒一个接力，而不是notify_all
+            //取了一批时也唤醒一个，有空闲线程的话让它分走批里的任务
+            if(taskSize_ > 0 || batched > 0)
+            {
+                idleLot_.notifyOne();
+            }
+
+            //当前线程负责执行这个任务，任务里从内存区分配的内存在它返回后整体回收
+            //等待future时帮忙执行的任务在helpOne里只回退到它开始时的位置，外层任务的内存还在用
+            uint64_t runBegin = runTask(task, stats, false);
+            arena.reset();
+            if(idleBegin != 0)
+            {
+                WorkerStats::add(stats->idleNs, runBegin - idleBegin);
+            }
+            if(batched > 0)
+            {
+                runBatch(batchQue, batch, stats, arena);
+            }
+
+            //任务处理结束空闲线程++
+            idleThreadSize_++;
+
+            //执行期间有阻塞区域结束，补偿线程多了，由一个非工作窃取下标的线程在任务之间退出
+            if(index < 0 && spareWorkers_.load(std::memory_order_relaxed) > 0 && retireSpare())
+            {
+                reclaimWorker(threadid, stats, &parker);
+                return;
+            }
+        }
+    }
+
+    //没有指定pause自旋次数时的默认值，多个cpu时IDLE_PAUSE_COUNT，只有一个cpu时0
+    static int autoIdlePauses()
+    {
+        return std::thread::hardware_concurrency() > 1 ? IDLE_PAUSE_COUNT : 0;
+    }
+
+    //IDLE_SPIN_PARK：先用pause自旋idlePauses_次，再让出cpu idleYields_次
+    //IDLE_BUSY_POLL：一直用pause自旋，线程池停止或者本线程该退出时返回false，后面的流程处理退出
+    bool spinForTask(int index, int node, std::minstd_rand& rng, Task& task)
+    {
+        if(idleStrategy_ == IdleStrategy::IDLE_BUSY_POLL)
+        {
+            for(;;)
+            {
+                for(int i = 0; i < IDLE_POLL_CHECK; i++)
+                {
+                    if(findTask(index, node, rng, task)) return true;
+                    cpuRelax();
+                }
+                if(!isPoolRunning_
+                    || (poolMode_ == PoolMode::MODE_CACHED && retireTokens_.load(std::memory_order_relaxed) > 0
+                        && curThreadSize_ - spareWorkers_ > elasticMin_)
+                    || (index < 0 && spareWorkers_.load(std::memory_order_relaxed) > blockedWorkers_.load(std::memory_order_relaxed)))
+                {
+                    return false;
+                }
+            }
+        }
+        for(int i = 0; i < idlePauses_; i++)
+        {
+            cpuRelax();
+            if(findTask(index, node, rng, task)) return true;
+        }
+        for(int i = 0; i < idleYields_; i++)
+        {
+            std::this_thread::yield();
+            if(findTask(index, node, rng, task)) return true;
+        }
+        return false;
+    }
+
+    //DEQUEUE_BATCH下取到一个任务后，从本节点注入队列一次取出一批放进本线程的批队列，每个线程最多分到排队任务的平均份额
+    //使用优先级车道或截止时间车道时不批量取，否则批里的普通任务会排到之后提交的高优先级任务前面
+    //批队列在取之前已经被本线程取空，容量不小于batchMax_，一批总能全部放下
+    //万一没有全部放下，剩下的放回原来的注入队列，仍然计在taskSize_里，返回值只算放进批队列的
+    //注入队列这期间又被填满时，再放不回去的留在batch里(放进去的被移走后为空)，由runBatch在本线程执行，也计入返回值
+    int fillBatch(int node, std::vector<Task>& batch, MpmcQueue<Task>* batchQue)
+    {
+        if(lanesInUse_.load(std::memory_order_relaxed) || edfSize_.load(std::memory_order_relaxed) > 0)
+        {
+            return 0;
+        }
+        int share = taskSize_.load(std::memory_order_relaxed) / std::max(1, curThreadSize_.load(std::memory_order_relaxed));
+        int want = std::min(share, (int)batch.size());
+        if(want <= 0) return 0;
+        int& cursor = currentWorker().shardCursor;
+        for(int i = 0; i < injectShards_; i++)
+        {
+            int shard = (cursor + i) % injectShards_;
+            int n = (int)injectQue(node, shard).tryPopBulk(batch.begin(), (size_t)want);
+            if(n > 0)
+            {
+                cursor = shard + 1;
+                notifyProducer();
+                int pushed = (int)batchQue->tryPushBulk(batch.begin(), (size_t)n);
+                batchHeld_.fetch_add(pushed, std::memory_order_relaxed);
+                if(pushed < n)
+                {
+                    n -= (int)injectQue(node, shard).tryPushBulk(batch.begin() + pushed, (size_t)(n - pushed));
+                }
+                return n;
+            }
+        }
+        return 0;
+    }
+
+    //依次执行本线程批队列里的任务，直到被本线程或者其他线程取空，再执行fillBatch没能放进批队列、留在batch里的任务(可能在任意位置，其余位置都已被移走为空)
+    //其他线程拿走一个时自己减batchHeld_，本线程取的在最后一次减掉
+    void runBatch(MpmcQueue<Task>* batchQue, std::vector<Task>& batch, WorkerStats* stats, TaskArena& arena)
+    {
+        int ran = 0;
+        Task task;
+        while(batchQue->tryPop(task))
+        {
+            ran++;
+            runTask(task, stats, false);
+            arena.reset();
+        }
+        batchHeld_.fetch_sub(ran, std::memory_order_relaxed);
+        for(size_t i = 0; i < batch.size(); i++)
+        {
+            if(batch[i] == nullptr) continue;
+            runTask(batch[i], stats, false);
+            batch[i] = nullptr;
+            arena.reset();
+        }
+    }
+
+    //findTask里从批队列取任务：调用者会把它当成注入队列里的任务减taskSize_，这里先加回来
+    bool popBatched(MpmcQueue<Task>* que, Task& task)
+    {
+        if(!que->tryPop(task)) return false;
+        batchHeld_.fetch_sub(1, std::memory_order_relaxed);
+        taskSize_++;
+        return true;
+    }
+
+    //从随机一个槽位开始，在其他线程的批队列里找一个还没执行的任务
+    bool stealBatched(MpmcQueue<Task>* own, std::minstd_rand& rng, Task& task)
+    {
+        int count = batchSlotCount_;
+        int first = (int)(rng() % (unsigned)count);
+        for(int i = 0; i < count; i++)
+        {
+            MpmcQueue<Task>* que = batchSlots_[(first + i) % count].que.load(std::memory_order_acquire);
+            if(que == nullptr || que == own) continue;
+            if(popBatched(que, task)) return true;
+        }
+        return false;
+    }
+
+    //给DEQUEUE_BATCH下新启动的工作线程一个批队列槽位，槽位用完时这个线程不批量取
+    //队列第一次用到时创建，线程退出后留给下一个线程，析构时释放
+    MpmcQueue<Task>* acquireBatchQue()
+    {
+        if(batchSlotCount_ == 0) return nullptr;
+        std::lock_guard<std::mutex> lock(statsMtx_);
+        for(int i = 0; i < batchSlotCount_; i++)
+        {
+            BatchSlot& slot = batchSlots_[i];
+            if(slot.inUse) continue;
+            slot.inUse = true;
+            MpmcQueue<Task>* que = slot.que.load(std::memory_order_relaxed);
+            if(que == nullptr)
+            {
+                que = new MpmcQueue<Task>(batchMax_);
+                slot.que.store(que, std::memory_order_release);
+            }
+            return que;
+        }
+        return nullptr;
+    }
+
+    //线程退出前已经执行完自己的批，队列是空的
+    void releaseBatchQue(MpmcQueue<Task>* que)
+    {
+        if(que == nullptr) return;
+        std::lock_guard<std::mutex> lock(statsMtx_);
+        for(int i = 0; i < batchSlotCount_; i++)
+        {
+            if(batchSlots_[i].que.load(std::memory_order_relaxed) == que)
+            {
+                batchSlots_[i].inUse = false;
+                return;
+            }
+        }
+    }
+
+    //空闲线程借给别的线程池：调用idleWork_，它执行了一个别的线程池的任务就回收内存区，返回true
+    bool lendIdle(TaskArena& arena)
+    {
+        if(!idleWork_ || !isPoolRunning_) return false;
+        if(!idleWork_()) return false;
+        arena.reset();
+        return true;
+    }
+
+    //回收当前线程
+    //线程数量相关变量的修改
+    //把线程对象从线程列表容器中删除 通过线程id
+    void reclaimWorker(int threadid, WorkerStats* stats, Parker* parker)
+    {
+        unregisterRetirable(parker);
+        releaseStats(stats);
+        releaseBatchQue(currentWorker().batchQue);
+        threadsReclaimed_++;
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        retireThread(threadid);
+        curThreadSize_--;
+        idleThreadSize_--;
+        currentWorker() = WorkerContext();
+        currentFutureHelper() = nullptr;
+    }
+
+    //调用时持有taskQueMtx_：线程不能join自己，把自己的线程对象从线程列表移到retired_，由下一次创建线程或者关闭时join
+    void retireThread(int threadid)
+    {
+        auto it = threads_.find(threadid);
+        if(it != threads_.end())
+        {
+            retired_.push_back(std::move(it->second));
+            threads_.erase(it);
+        }
+        exitCond_.notify_all();
+    }
+
+    //进入阻塞区域：补偿线程少于阻塞的线程时补一个，线程总数不超过threadSizeThreshHold_
+    void enterBlocking()
+    {
+        int blocked = ++blockedWorkers_;
+        if(spareWorkers_ >= blocked) return; //之前补的线程还在，可能正空闲着
+        std::lock_guard<std::mutex> lock(taskQueMtx_);
+        if(!isPoolRunning_ || curThreadSize_ >= threadSizeThreshHold_) return;
+        spareWorkers_++;
+        spawnThread();
+    }
+
+    //离开阻塞区域：补偿线程多了，唤醒一个挂起的、没有本地队列的线程让它退出；都在忙的话由先执行完任务的线程退出
+    void leaveBlocking()
+    {
+        int blocked = --blockedWorkers_;
+        if(spareWorkers_ <= blocked) return;
+        //在spareMtx_内唤醒，线程退出前要先拿这把锁注销，不会唤醒已经销毁的Parker
+        std::lock_guard<std::mutex> lock(spareMtx_);
+        for(Parker* p : retirable_)
+        {
+            if(idleLot_.cancel(p))
+            {
+                p->unpark();
+                return;
+            }
+        }
+    }
+
+    void unregisterRetirable(Parker* parker)
+    {
+        std::lock_guard<std::mutex> lock(spareMtx_);
+        retirable_.erase(std::remove(retirable_.begin(), retirable_.end(), parker), retirable_.end());
+    }
+
+    bool retireSpare()
+    {
+        int spares = spareWorkers_.load(std::memory_order_relaxed);
+        while(spares > blockedWorkers_.load(std::memory_order_relaxed))
+        {
+            if(spareWorkers_.compare_exchange_weak(spares, spares - 1, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+
+    //取任务顺序：截止时间车道 -> 高优先级车道 -> 本地队列(LIFO) -> 自己的批队列 -> 本节点注入队列 -> 低优先级车道
+    //  -> 其他线程的批队列 -> 随机选一个同节点的线程窃取(FIFO) -> 其他节点的注入队列 -> 窃取其他节点的线程
+    //没有开启NUMA感知时只有一个节点；注入队列分片时本节点的各片按游标轮流取
+    //普通和低优先级车道非空但连续被跳过PRIORITY_AGING_LIMIT次后，先取它们一次
+    bool findTask(int index, int node, std::minstd_rand& rng, Task& task)
+    {
+        TaskNode* taskNode = nullptr;
+        if(edfSize_.load(std::memory_order_relaxed) > 0 && popDeadlineTask(task))
+        {
+            return true;
+        }
+        bool lanes = lanesInUse_.load(std::memory_order_acquire);
+        if(lanes && popAgedTask(node, task))
+        {
+            return true;
+        }
+        if(lanes && highQue_->tryPop(task))
+        {
+            notifyProducer();
+            if(!injectedEmpty(node)) normalSkips_++;
+            if(!lowQue_->empty()) lowSkips_++;
+            return true;
+        }
+        if(index >= 0 && localQues_[index]->pop(taskNode))
+        {
+            task = std::move(taskNode->task);
+            freeNode(index, taskNode);
+            return true;
+        }
+        //等待future时帮忙执行，先取自己批里的任务，等待的结果可能就在里面
+        WorkerContext& ctx = currentWorker();
+        MpmcQueue<Task>* ownBatch = ctx.pool == this ? ctx.batchQue : nullptr;
+        if(ownBatch != nullptr && popBatched(ownBatch, task))
+        {
+            return true;
+        }
+        if(popInjected(node, task))
+        {
+            //取出一个任务，空出了位置，通知被阻塞的提交者
+            notifyProducer();
+            if(lanes)
+            {
+                normalSkips_ = 0;
+                if(!lowQue_->empty()) lowSkips_++;
+            }
+            return true;
+        }
+        if(lanes && lowQue_->tryPop(task))
+        {
+            notifyProducer();
+            lowSkips_ = 0;
+            return true;
+        }
+        if(batchHeld_.load(std::memory_order_relaxed) > 0 && stealBatched(ownBatch, rng, task))
+        {
+            return true;
+        }
+        //补偿线程没有本地队列(index为-1)，但也可以窃取
+        if(!localQues_.empty() && stealTask(index, rng, node, true, taskNode))
+        {
+            WorkerStats::add(currentWorker().stats->stolen, 1);
+            task = std::move(taskNode->task);
+            freeNode(index, taskNode);
+            return true;
+        }
+        if(injectNodes_ == 1)
+        {
+            return false;
+        }
+        if(popRemoteTask(node, task))
+        {
+            return true;
+        }
+        if(!localQues_.empty() && stealTask(index, rng, node, false, taskNode))
+        {
+            WorkerStats::add(currentWorker().stats->stolen, 1);
+            task = std::move(taskNode->task);
+            freeNode(index, taskNode);
+            return true;
+        }
+        return false;
+    }
+
+    //本节点没有任务时，从下一个节点开始依次取其他节点注入队列里的任务
+    bool popRemoteTask(int node, Task& task)
+    {
+        int nodes = injectNodes_;
+        for(int i = 1; i < nodes; i++)
+        {
+            if(popInjected((node + i) % nodes, task))
+            {
+                notifyProducer();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //被跳过太多次的车道先取一次，防止饿死
+    bool popAgedTask(int node, Task& task)
+    {
+        if(lowSkips_.load(std::memory_order_relaxed) >= PRIORITY_AGING_LIMIT && lowQue_->tryPop(task))
+        {
+            lowSkips_ = 0;
+            notifyProducer();
+            return true;
+        }
+        if(normalSkips_.load(std::memory_order_relaxed) >= PRIORITY_AGING_LIMIT && popInjected(node, task))
+        {
+            normalSkips_ = 0;
+            notifyProducer();
+            return true;
+        }
+        return false;
+    }
+
+    //取截止时间最早的任务，已经过期的让future失败后丢弃，继续取下一个
+    //过期任务在锁外析构，它的promise可能触发后续任务
+    bool popDeadlineTask(Task& task)
+    {
+        for(;;)
+        {
+            DeadlineTask entry;
+            {
+                std::lock_guard<std::mutex> lock(edfMtx_);
+                if(edfHeap_.empty()) return false;
+                std::pop_heap(edfHeap_.begin(), edfHeap_.end(), DeadlineLater());
+                entry = std::move(edfHeap_.back());
+                edfHeap_.pop_back();
+                edfSize_.store((int)edfHeap_.size(), std::memory_order_relaxed);
+            }
+            if(std::chrono::steady_clock::now() < entry.deadline)
+            {
+                task = std::move(entry.task);
+                return true;
+            }
+            entry.state->trySetException(deadlineExpiredError());
+            tasksExpired_++;
+            taskSize_--;
+        }
+    }
+
+    //提交失败的原因：线程池已经关闭，或者队列满
+    std::exception_ptr rejectedError() const
+    {
+        if(shutdown_.load(std::memory_order_relaxed))
+        {
+            return std::make_exception_ptr(std::runtime_error("thread pool is shut down, submit task failed"));
+        }
+        return std::make_exception_ptr(std::runtime_error("task queue is full, submit task failed"));
+    }
+
+    static std::exception_ptr deadlineExpiredError()
+    {
+        return std::make_exception_ptr(std::runtime_error("task deadline expired"));
+    }
+
+    //批量提交的公共部分，没能放进队列的任务让future直接失败
+    template<typename RType>
+    void submitTasks(std::vector<Task>& tasks, std::vector<Future<RType>>& results)
+    {
+        size_t pushed = pushTasks(tasks);
+        tasksRejected_ += results.size() - pushed;
+        for(size_t i = pushed; i < results.size(); i++)
+        {
+            setFutureException(results[i], rejectedError());
+        }
+    }
+
+    //从当前工作线程的缓存取一个任务节点，缓存空了再分配一块
+    TaskNode* allocNode(int index, Task&& task)
+    {
+        NodeCache& cache = nodeCaches_[index];
+        if(cache.head == nullptr)
+        {
+            //把别的线程还回来的节点整体取过来，只有owner取，不存在ABA
+            TaskNode* remote = cache.remoteFree.exchange(nullptr, std::memory_order_acquire);
+            while(remote != nullptr)
+            {
+                TaskNode* next = remote->next;
+                remote->next = cache.head;
+                cache.head = remote;
+                remote = next;
+            }
+        }
+        if(cache.head == nullptr)
+        {
+            //节点数翻倍，一次很深的嵌套提交只分配几块
+            int count = std::max(NODE_CHUNK_SIZE, cache.capacity);
+            cache.chunks.emplace_back(new TaskNode[count]);
+            cache.capacity += count;
+            TaskNode* chunk = cache.chunks.back().get();
+            for(int i = 0; i < count; i++)
+            {
+                chunk[i].owner = index;
+                chunk[i].next = cache.head;
+                cache.head = &chunk[i];
+            }
+        }
+        TaskNode* node = cache.head;
+        cache.head = node->next;
+        node->task = std::move(task);
+        return node;
+    }
+
+    void freeNode(int index, TaskNode* node)
+    {
+        if(node->owner != index)
+        {
+            NodeCache& owner = nodeCaches_[node->owner];
+            node->next = owner.remoteFree.load(std::memory_order_relaxed);
+            while(!owner.remoteFree.compare_exchange_weak(node->next, node,
+                std::memory_order_release, std::memory_order_relaxed))
+            {}
+            return;
+        }
+        NodeCache& cache = nodeCaches_[index];
+        node->next = cache.head;
+        cache.head = node;
+    }
+
+    //任务放入有界队列并唤醒一个空闲线程，按提交策略处理队列满的情况
+    //wait为false时队列满直接返回false，task保持不变
+    bool pushTask(Task&& task, bool wait = true)
+    {
+        if(!acceptingTasks()) return false;
+        //工作窃取模式下，池内线程提交的任务直接放进自己的本地队列，不经过全局队列
+        task.setStamp(statsNowNs());
+        WorkerContext& ctx = currentWorker();
+        if(ctx.pool == this && ctx.index >= 0)
+        {
+            localQues_[ctx.index]->push(allocNode(ctx.index, std::move(task)));
+            taskSize_++;
+            //唤醒一个挂起的线程来窃取
+            notifyWorker();
+            notifyBacklog();
+            return true;
+        }
+
+        MpmcQueue<Task>& que = submitQue();
+        if(!que.tryPush(std::move(task)) && (!wait || !waitForSlot(que, task)))
+        {
+            return false;
+        }
+        taskSize_++;
+        notifyWorker();
+        growIfNeeded();
+        notifyBacklog();
+        return true;
+    }
+
+    //批量放入，每次一个CAS预留一段连续槽位，每段只唤醒min(段长, 挂起线程数)个线程
+    //返回成功放入的任务数，失败的只会是末尾的一段
+    size_t pushTasks(std::vector<Task>& tasks)
+    {
+        if(!acceptingTasks()) return 0;
+        size_t n = tasks.size();
+        uint64_t stamp = statsNowNs();
+        for(Task& task : tasks) task.setStamp(stamp);
+        WorkerContext& ctx = currentWorker();
+        if(ctx.pool == this && ctx.index >= 0)
+        {
+            for(Task& task : tasks)
+            {
+                localQues_[ctx.index]->push(allocNode(ctx.index, std::move(task)));
+            }
+            taskSize_ += (int)n;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            idleLot_.wake((int)n);
+            notifyBacklog();
+            return n;
+        }
+
+        MpmcQueue<Task>& que = submitQue();
+        size_t done = 0;
+        while(done < n)
+        {
+            size_t cnt = que.tryPushBulk(tasks.begin() + done, n - done);
+            if(cnt == 0)
+            {
+                //队列满，按提交策略等待一个空位
+                if(!waitForSlot(que, tasks[done])) break;
+                cnt = 1;
+            }
+            done += cnt;
+            taskSize_ += (int)cnt;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            idleLot_.wake((int)cnt);
+            for(size_t i = 0; i < cnt; i++)
+            {
+                if(!growIfNeeded()) break;
+            }
+            notifyBacklog();
+        }
+        return done;
+    }
+
+    //需要根据任务数量和空闲线程的数量，判断是否需要创建新的线程出来，创建了返回true
+    //cached模式且任务数量大于空闲线程数量，且当前线程数量少于弹性控制器给出的目标
+    //目标由控制器按采样结果调整，提交路径只负责快速补足到目标，并且限制创建速率，突发时不会一下子创建一大批
+    bool growIfNeeded()
+    {
+        if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_
+            && curThreadSize_ - spareWorkers_ < elasticTarget_ && spawnAllowed())
+        {
+            std::lock_guard<std::mutex> lock(taskQueMtx_);
+            if(curThreadSize_ - spareWorkers_ >= elasticTarget_ || !isPoolRunning_) return false;
+            spawnThread();
+            return true;
+        }
+        return false;
+    }
+
+    //调用时持有taskQueMtx_
+    //先join已经退出的线程，retired_里的线程已经离开了临界区，马上就会返回
+    void spawnThread()
+    {
+        for(auto& thread : retired_)
+        {
+            thread->join();
+        }
+        retired_.clear();
+        //创建新线程
+        //创建线程对象的时候，把线程函数给到thread线程对象
+        auto ptr = std::make_unique<Thread>([this](int threadid){ threadFunc(threadid, -1); });
+        int threadId = ptr->getId();
+        threads_.emplace(threadId, std::move(ptr));
+        threads_[threadId]->start();
+        //修改线程数量相关变量
+        idleThreadSize_++;
+        curThreadSize_++;
+        threadsCreated_++;
+    }
+
+    //两次创建线程之间至少间隔spawnInterval，抢到这个时间窗口的提交者才能创建
+    bool spawnAllowed()
+    {
+        uint64_t now = statsNowNs();
+        uint64_t last = lastSpawnNs_.load(std::memory_order_relaxed);
+        uint64_t interval = (uint64_t)std::chrono::nanoseconds(elasticOptions_.spawnInterval).count();
+        if(last != 0 && now - last < interval) return false;
+        return lastSpawnNs_.compare_exchange_strong(last, now, std::memory_order_relaxed);
+    }
+
+    //补偿线程不算在弹性伸缩的线程数里，它们由阻塞区域自己回收
+    bool takeRetireToken()
+    {
+        if(curThreadSize_ - spareWorkers_ <= elasticMin_) return false;
+        int tokens = retireTokens_.load(std::memory_order_relaxed);
+        while(tokens > 0)
+        {
+            if(retireTokens_.compare_exchange_weak(tokens, tokens - 1, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+
+    //弹性控制器线程：每隔sampleInterval采样一次统计，交给ElasticController得到目标线程数，再扩容或缩容
+    void elasticLoop()
+    {
+        int minThreads = elasticOptions_.minThreads > 0 ? elasticOptions_.minThreads : (int)initThreadSize_;
+        int maxThreads = elasticOptions_.maxThreads > 0 ? elasticOptions_.maxThreads : threadSizeThreshHold_;
+        ElasticController controller(minThreads, maxThreads, (int)initThreadSize_, elasticOptions_);
+        elasticTarget_ = controller.target();
+        elasticMin_ = std::max(1, minThreads);
+
+        PoolStats last = stats();
+        auto lastTime = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(elasticMtx_);
+        while(!elasticCond_.wait_for(lock, elasticOptions_.sampleInterval, [this]()->bool{ return elasticStop_; }))
+        {
+            lock.unlock();
+            PoolStats cur = stats();
+            auto now = std::chrono::steady_clock::now();
+
+            ElasticSample sample;
+            sample.seconds = std::chrono::duration<double>(now - lastTime).count();
+            sample.completed = cur.tasksExecuted - last.tasksExecuted;
+            sample.queued = cur.queuedTasks;
+            sample.threads = cur.threads;
+            sample.idle = cur.idleThreads;
+            StatsHistogram waits;
+            for(int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+            {
+                waits.counts[i] = cur.queueWait.counts[i] - last.queueWait.counts[i];
+            }
+            //这段时间没有任务开始执行但有排队：排队的任务至少等了整个采样间隔
+            sample.queueWaitP90 = waits.total() > 0 ? waits.percentile(0.9)
+                : (sample.queued > 0 ? std::chrono::duration_cast<std::chrono::nanoseconds>(now - lastTime)
+                : std::chrono::nanoseconds(0));
+
+            resizeTo(controller.update(sample));
+            last = cur;
+            lastTime = now;
+            lock.lock();
+        }
+    }
+
+    //目标变大时直接补足(不超过排队任务需要的数量)，变小时给多余的空闲线程发退出名额
+    void resizeTo(int target)
+    {
+        elasticTarget_ = target;
+        int cur = curThreadSize_ - spareWorkers_;
+        if(target > cur)
+        {
+            int need = std::min(target - cur, taskSize_ - idleThreadSize_);
+            std::lock_guard<std::mutex> lock(taskQueMtx_);
+            for(int i = 0; i < need && isPoolRunning_; i++) spawnThread();
+            retireTokens_ = 0;
+        }
+        else if(target < cur)
+        {
+            int surplus = std::min(cur - target, (int)idleThreadSize_);
+            retireTokens_ = std::max(0, surplus);
+            for(int i = 0; i < surplus; i++)
+            {
+                if(!idleLot_.wakeOldest()) break;
+            }
+        }
+        else
+        {
+            retireTokens_ = 0;
+        }
+    }
+
+    //队列满时按提交策略等待空位，成功放入返回true
+    bool waitForSlot(MpmcQueue<Task>& que, Task& task)
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        switch(submitPolicy_)
+        {
+        case SubmitPolicy::POLICY_TRY_ONCE:
+            return false;
+        case SubmitPolicy::POLICY_SPIN_PARK:
+            for(int i = 0; i < SUBMIT_SPIN_COUNT; i++)
+            {
+                std::this_thread::yield();
+                if(que.tryPush(std::move(task))) return true;
+            }
+            break;
+        case SubmitPolicy::POLICY_TIMED:
+            deadline = std::chrono::steady_clock::now() + submitTimeout_;
+            break;
+        case SubmitPolicy::POLICY_BLOCK:
+            break;
+        }
+
+        //登记等待的提交者后再重试，消费者看到登记才去notFull_上通知
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
+        waitingProducers_++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ok = false;
+        for(;;)
+        {
+            if(que.tryPush(std::move(task)))
+            {
+                ok = true;
+                break;
+            }
+            if(deadline == std::chrono::steady_clock::time_point::max())
+            {
+                notFull_.wait(lock);
+            }
+            else if(notFull_.wait_until(lock, deadline) == std::cv_status::timeout)
+            {
+                ok = que.tryPush(std::move(task));
+                break;
+            }
+        }
+        waitingProducers_--;
+        return ok;
+    }
+
+    //本池没有空闲线程时告诉设置了回调的一方(线程池组)，它可以叫醒别的线程池的空闲线程来帮忙
+    //每个新任务计入taskSize_的地方都调用(各车道、本地队列、注入队列)；findTask从批队列取出时的加一只是抵消，不算新任务
+    void notifyBacklog()
+    {
+        if(backlogCallback_ && idleThreadSize_.load(std::memory_order_relaxed) <= 0)
+        {
+            backlogCallback_();
+        }
+    }
+
+    //没有线程在自旋找任务时，唤醒恰好一个挂起的线程
+    void notifyWorker()
+    {
+        idleLot_.notifyOne();
+    }
+
+    //只有确实有提交者阻塞在队列满上才去加锁通知
+    //使用优先级车道或者有多个注入队列时提交者可能在等不同的队列，全部唤醒让它们各自重试
+    void notifyProducer()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waitingProducers_ > 0)
+        {
+            std::lock_guard<std::mutex> lock(taskQueMtx_);
+            if(lanesInUse_.load(std::memory_order_relaxed) || !injectQues_.empty())
+            {
+                notFull_.notify_all();
+            }
+            else
+            {
+                notFull_.notify_one();
+            }
+        }
+    }
+
+    //从随机的其他线程开始，依次尝试窃取一轮
+    //开启NUMA感知时sameNode为true只窃取同节点的线程，为false只窃取其他节点的线程
+    bool stealTask(int self, std::minstd_rand& rng, int node, bool sameNode, TaskNode*& task)
+    {
+        int n = (int)localQues_.size();
+        if(n <= 1) return false;
+        int start = (int)(rng() % n);
+        for(int i = 0; i < n; i++)
+        {
+            int victim = (start + i) % n;
+            if(victim == self) continue;
+            if(!workerNodes_.empty() && (workerNodes_[victim] == node) != sameNode) continue;
+            if(localQues_[victim]->steal(task)) return true;
+        }
+        return false;
+    }
+
+    //给新启动的工作线程一份计数器，优先复用已经退出的线程留下的，累计值保留
+    WorkerStats* acquireStats()
+    {
+        std::lock_guard<std::mutex> lock(statsMtx_);
+        for(auto& worker : workerStats_)
+        {
+            if(!worker->inUse)
+            {
+                worker->inUse = true;
+                return worker.get();
+            }
+        }
+        workerStats_.push_back(std::make_unique<WorkerStats>());
+        workerStats_.back()->inUse = true;
+        return workerStats_.back().get();
+    }
+
+    void releaseStats(WorkerStats* stats)
+    {
+        std::lock_guard<std::mutex> lock(statsMtx_);
+        stats->inUse = false;
+    }
+
+    //统计回调线程：每隔statsPeriod_调用一次回调，直到线程池析构
+    void statsLoop()
+    {
+        std::unique_lock<std::mutex> lock(statsMtx_);
+        while(!statsCond_.wait_for(lock, statsPeriod_, [this]()->bool{ return statsStop_; }))
+        {
+            lock.unlock();
+            statsCallback_(stats());
+            lock.lock();
+        }
+    }
+
+    //节点的第shard个注入队列，节点0的第0片(没有开启NUMA感知也不分片时唯一的注入队列)是taskQue_
+    MpmcQueue<Task>& injectQue(int node, int shard = 0)
+    {
+        int i = node * injectShards_ + shard;
+        return i <= 0 ? *taskQue_ : *injectQues_[i];
+    }
+
+    //提交者放入的注入队列：所在节点里按提交线程选一片
+    MpmcQueue<Task>& submitQue()
+    {
+        return injectQue(submitNode(), injectShards_ > 1 ? submitterSlot() % injectShards_ : 0);
+    }
+
+    //从节点的注入队列取一个任务；分片时从本线程的游标开始轮流看各片，取到后游标移到下一片，各片都能轮到
+    bool popInjected(int node, Task& task)
+    {
+        if(injectShards_ == 1) return injectQue(node).tryPop(task);
+        int& cursor = currentWorker().shardCursor;
+        for(int i = 0; i < injectShards_; i++)
+        {
+            int shard = (cursor + i) % injectShards_;
+            if(injectQue(node, shard).tryPop(task))
+            {
+                cursor = shard + 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool injectedEmpty(int node)
+    {
+        for(int shard = 0; shard < injectShards_; shard++)
+        {
+            if(!injectQue(node, shard).empty()) return false;
+        }
+        return true;
+    }
+
+    //每一片注入队列的容量，上限阈值平均分给各片
+    int shardCapacity() const
+    {
+        return std::max(1, taskQueMaxThreshHold_ / injectShards_);
+    }
+
+    //提交线程的编号，第一次提交时按顺序分配，决定它放进哪一片注入队列
+    static int submitterSlot()
+    {
+        static std::atomic_int next(0);
+        static thread_local int slot = next++;
+        return slot;
+    }
+
+    //提交者所在的节点：池内线程用自己的节点，池外线程看当前运行在哪个cpu上
+    int submitNode() const
+    {
+        if(injectNodes_ == 1) return 0;
+        WorkerContext& ctx = currentWorker();
+        if(ctx.pool == this) return ctx.node;
+        return topology_.nodeOf(currentCpu());
+    }
+
+    //首次访问分配时共享状态来自提交者所在节点的内存池，任务也进入这个节点的队列，通常由本节点的线程完成
+    StatePool* submitStatePool() const
+    {
+        if(statePools_.empty()) return statePool_;
+        return statePools_[submitNode()];
+    }
+
+    //按亲和性策略排好的cpu序列，第i个工作线程绑定第i个(超出时从头循环)
+    std::vector<int> placementOrder() const
+    {
+        switch(affinityPolicy_)
+        {
+        case AffinityPolicy::AFFINITY_COMPACT:
+            return topology_.compactOrder();
+        case AffinityPolicy::AFFINITY_SCATTER:
+            return topology_.scatterOrder();
+        case AffinityPolicy::AFFINITY_EXPLICIT:
+            return affinityCpus_;
+        case AffinityPolicy::AFFINITY_NONE:
+            break;
+        }
+        //NUMA感知需要知道每个线程在哪个节点
+        return numaAware_ ? topology_.scatterOrder() : std::vector<int>();
+    }
+
+    int nodeOfSlot(int slot) const
+    {
+        if(placement_.empty() || injectNodes_ == 1) return 0;
+        return topology_.nodeOf(placement_[slot % placement_.size()]);
+    }
+
+    //把当前工作线程绑定到第slot个位置的cpu上，返回它所在的节点
+    //绑定失败(cpu不在允许的集合里)时线程照常运行，仍然按这个节点取任务
+    int placeWorker(int slot)
+    {
+        if(placement_.empty()) return 0;
+        pinCurrentThread(placement_[slot % placement_.size()]);
+        int node = nodeOfSlot(slot);
+        if(!statePools_.empty())
+        {
+            statePools_[node]->prefault(NUMA_PREFAULT_STATES);
+        }
+        return node;
+    }
+
+private:
+    // std::vector<std::unique_ptr<Thread>> threads_;//线程列表
+    std::unordered_map<int, std::unique_ptr<Thread>> threads_; //线程列表
+    std::vector<std::unique_ptr<Thread>> retired_; //已经退出、还没有join的线程，下次创建线程或关闭时join
+    size_t initThreadSize_;  //初始的线程数量
+    int threadSizeThreshHold_; //线程数量上限
+    std::atomic_int  idleThreadSize_; //空闲线程的数量
+    std::atomic_int curThreadSize_;//当前线程总数 vec.size()不是线程安全的
+
+
+    //需要保证任务对象声明周期，调用run之后才析构
+    std::atomic_int  taskSize_;   //任务的数量
+    int taskQueMaxThreshHold_;  //任务队列数量上限阈值
+    std::unique_ptr<MpmcQueue<Task>> taskQue_;//有界无锁任务队列，工作窃取模式下作为全局注入队列，也是普通优先级车道
+    std::unique_ptr<MpmcQueue<Task>> highQue_; //高优先级车道，第一次使用时创建
+    std::unique_ptr<MpmcQueue<Task>> lowQue_; //低优先级车道，第一次使用时创建
+    std::once_flag lanesOnce_;
+    std::once_flag keyedOnce_;
+    std::vector<Strand> keyedStrands_; //submitKeyed使用的strand，第一次使用时创建
+    std::atomic_bool lanesInUse_; //高/低优先级车道已经创建
+    std::atomic_int normalSkips_; //普通车道非空时被跳过的次数
+    std::atomic_int lowSkips_; //低优先级车道非空时被跳过的次数
+    std::mutex edfMtx_; //保护截止时间车道
+    std::vector<DeadlineTask> edfHeap_; //截止时间车道，按截止时间的小顶堆
+    uint64_t edfSeq_; //截止时间车道的提交序号
+    std::atomic_int edfSize_; //截止时间车道的任务数，工作线程不加锁先看一眼
+    std::vector<std::unique_ptr<WorkStealingDeque<TaskNode*>>> localQues_; //工作窃取模式下每个线程的本地队列
+    std::vector<NodeCache> nodeCaches_; //工作窃取模式下每个线程的空闲任务节点缓存
+    std::atomic_int waitingProducers_; //阻塞在队列满上的提交者数量
+    SubmitPolicy submitPolicy_; //队列满时的提交策略
+    std::chrono::milliseconds submitTimeout_; //POLICY_TIMED的最长等待时间
+    DequeueMode dequeueMode_; //工作线程取任务的方式
+    int batchMax_; //DEQUEUE_BATCH下一批最多的任务数
+    std::unique_ptr<BatchSlot[]> batchSlots_; //DEQUEUE_BATCH下每个工作线程取出的一批任务，启动时分配
+    int batchSlotCount_;
+    std::atomic_int batchHeld_; //各线程批里还没执行的任务数，近似值，为0时不去别的线程的批里找
+    IdleStrategy idleStrategy_; //工作线程空闲时的等待方式
+    int idlePauses_; //IDLE_SPIN_PARK下pause自旋的次数
+    int idleYields_; //IDLE_SPIN_PARK下让出cpu的次数
+    StatePool* statePool_; //任务结果共享状态的内存池
+    std::vector<StatePool*> statePools_; //首次访问分配时每个节点一个内存池
+
+    AffinityPolicy affinityPolicy_; //工作线程绑定cpu的方式
+    std::vector<int> affinityCpus_; //AFFINITY_EXPLICIT的cpu列表
+    CpuTopology topology_; //启动时按它计算绑定位置和节点
+    std::vector<int> placement_; //第i个工作线程绑定的cpu
+    std::atomic_int placementSeq_; //非工作窃取模式下按启动顺序分配绑定位置
+    bool numaAware_;
+    bool numaFirstTouch_;
+    int injectShards_; //每个节点的注入队列分成几片
+    int injectNodes_; //有几个节点各自有注入队列，没有开启NUMA感知时为1
+    std::vector<std::unique_ptr<MpmcQueue<Task>>> injectQues_; //多个节点或者分片时的全部注入队列，下标0为空，用taskQue_
+    std::vector<int> workerNodes_; //NUMA感知的工作窃取模式下每个线程所在的节点
+
+    std::mutex statsMtx_; //保护workerStats_的增长和槽位分配，以及统计回调线程的等待
+    std::vector<std::unique_ptr<WorkerStats>> workerStats_; //每个工作线程一份计数器，只增不减
+    std::atomic<uint64_t> tasksRejected_; //下面几项发生得很少，直接用共享的原子计数
+    std::atomic<uint64_t> tasksExpired_;
+    std::atomic<uint64_t> tasksBorrowed_;
+    std::atomic<uint64_t> threadsCreated_;
+    std::atomic<uint64_t> threadsReclaimed_;
+    std::function<void(const PoolStats&)> statsCallback_;
+    std::chrono::milliseconds statsPeriod_{1000};
+    std::thread statsThread_;
+    std::condition_variable statsCond_;
+    bool statsStop_;
+
+    std::function<bool()> idleWork_; //空闲线程挂起前调用，线程池组借出线程
+    std::function<void()> backlogCallback_; //提交时没有空闲线程调用
+    std::atomic_int lentActive_; //正在借出线程上执行的本池任务数，关闭时等它回到0
+
+    ElasticOptions elasticOptions_; //cached模式的弹性伸缩参数
+    std::atomic_int elasticTarget_; //弹性控制器给出的目标线程数
+    std::atomic_int elasticMin_; //弹性伸缩的最少线程数
+    std::atomic_int retireTokens_; //缩容时发放的退出名额
+    std::atomic<uint64_t> lastSpawnNs_; //上一次在提交路径上创建线程的时间
+    std::thread elasticThread_;
+    std::mutex elasticMtx_;
+    std::condition_variable elasticCond_;
+    bool elasticStop_;
+
+    std::once_flag timersOnce_;
+    std::shared_ptr<TimerWheel> timers_; //定时任务的时间轮，TimerHandle只持有它的弱引用
+    std::thread timerThread_;
+    std::mutex timerMtx_;
+    std::condition_variable timerCond_;
+    std::chrono::steady_clock::time_point timerWake_; //定时线程计划醒来的时间
+    bool timerStop_;
+
+    std::atomic_int blockedWorkers_; //在阻塞区域里的工作线程数
+    std::atomic_int spareWorkers_; //为阻塞区域补充的线程数
+    std::mutex spareMtx_; //保护retirable_
+    std::vector<Parker*> retirable_; //没有本地队列的工作线程的停车位，阻塞区域结束时从中唤醒一个退出
+
+    std::mutex taskQueMtx_; //保证线程列表和提交者等待的线程安全
+    std::condition_variable notFull_; //任务队列不满
+    ParkingLot idleLot_; //挂起的空闲线程登记表，用于精确唤醒
+    std::condition_variable exitCond_; //等待线程资源全部回收
+
+    std::mutex shutdownMtx_; //并发调用shutdown时串行化
+    std::atomic_bool shutdown_; //已经开始关闭，池外线程的提交被拒绝
+    std::atomic_bool cancelPending_; //按SHUTDOWN_CANCEL处理取出的任务
+    CancellationSource shutdownSource_; //工作线程默认的CancellationToken::current()，取消排队任务时一起取消
+
+
+    PoolMode poolMode_; //当前线程池的工作模式
+    //当前线程池的启动状态，可能会在多个线程里面使用到
+    std::atomic_bool  isPoolRunning_; //当前线程池的启动状态
 
-    PoolMode poolMode_; //当前线程池的工作模式
-    //当前线程池的启动状态，可能会在多个线程里面使用到
-    std::atomic_bool  isPoolRunning_; //当前线程池的启动状态
-    
 
 };
 
 
-#endif
\ No newline at end of file
+#endif
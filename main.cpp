@@ -10,7 +10,7 @@ using uLong = unsigned long long;
  main thread: 给每一个线程分配计算的区间，
 并等待他们算完返回结果，合并最终的结果
 */
-class MyTask : public Task
+class MyTask : public TypedTask<uLong>
 {
 public:
     MyTask(int begin, int end)
@@ -18,9 +18,9 @@ public:
         , end_(end){};
 
 
-    //怎么设计run函数的返回值，可以表示任意的类型
+    //返回值类型由TypedTask<uLong>确定，结果直接存放在共享状态里
     //在线程池分配的线程中去执行
-    Any run()
+    uLong call()
     {
         std::cout<<"tid:"<<std::this_thread::get_id()
         <<"begin!"<<std::endl;
@@ -54,14 +54,16 @@ int main()
     //开始启动线程池之前相关参数已经设置好
     pool.start(4);
 
-    //如何设计Result机制呢
-    Result res1 = pool.submitTask(std::make_shared<MyTask>(1, 100000000));
-    Result res2 = pool.submitTask(std::make_shared<MyTask>(100000001, 200000000));
-    Result res3 = pool.submitTask(std::make_shared<MyTask>(200000001, 300000000));
+    TypedResult<uLong> res1 = pool.submitTask(std::make_shared<MyTask>(1, 100000000));
+    TypedResult<uLong> res2 = pool.submitTask(std::make_shared<MyTask>(100000001, 200000000));
+    TypedResult<uLong> res3 = pool.submitTask(std::make_shared<MyTask>(200000001, 300000000));
 
-    uLong sum1 = res1.get().cast_<uLong>(); //get返回Any类型，
-    uLong sum2 = res2.get().cast_<uLong>(); 
-    uLong sum3 = res3.get().cast_<uLong>(); 
+    //三个部分和都算完后，合并任务直接调度到线程池执行，中间没有线程阻塞在get()上
+    TypedResult<uLong> total = when_all(std::move(res1), std::move(res2), std::move(res3)).then(
+        [](std::tuple<TypedResult<uLong>, TypedResult<uLong>, TypedResult<uLong>> parts)
+        {
+            return std::get<0>(parts).get() + std::get<1>(parts).get() + std::get<2>(parts).get();
+        });
 
 
     // pool.submitTask(std::make_shared<MyTask>());
@@ -72,7 +74,7 @@ int main()
     // pool.submitTask(std::make_shared<MyTask>());
     // pool.submitTask(std::make_shared<MyTask>());
 
-    std::cout<<(sum1+sum2+sum3)<<std::endl;
+    std::cout<<total.get()<<std::endl;
 
     getchar();
 
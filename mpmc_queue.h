@@ -0,0 +1,216 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <thread>
+
+
+//有界无锁多生产者多消费者环形队列(Vyukov)
+//每个槽位带一个序号：seq==pos表示可写，seq==pos+1表示可读
+//head/tail各自独占一个缓存行，避免生产者和消费者互相伪共享
+template<typename T>
+class MpmcQueue
+{
+public:
+    //容量向上取整到2的幂
+    explicit MpmcQueue(size_t capacity)
+    {
+        size_t cap = 2;
+        while(cap < capacity) cap <<= 1;
+        mask_ = cap - 1;
+        slots_.reset(new Slot[cap]);
+        for(size_t i = 0; i < cap; i++)
+        {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    ~MpmcQueue()
+    {
+        T item;
+        while(tryPop(item)) {}
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    //队列满返回false，item保持不变
+    bool tryPush(T&& item)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0)
+            {
+                if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    new (slot.ptr()) T(std::move(item));
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                //槽位还没被消费者取走，队列满
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //批量放入：一次CAS在tail上预留连续的槽位，空间不够时只预留放得下的部分
+    //返回实际放入的数量，放入的元素从first开始依次被移走
+    template<typename Iter>
+    size_t tryPushBulk(Iter first, size_t count)
+    {
+        if(count == 0) return 0;
+        size_t cap = mask_ + 1;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        size_t n = 0;
+        for(;;)
+        {
+            size_t head = head_.load(std::memory_order_acquire);
+            intptr_t used = (intptr_t)(pos - head);
+            if(used < 0)
+            {
+                //pos已经过时
+                pos = tail_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if((size_t)used >= cap) return 0;
+            n = std::min(count, cap - (size_t)used);
+            if(tail_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        //预留的槽位已经被消费者越过，如果消费者还没写回序号，稍等一下
+        for(size_t i = 0; i < n; i++, ++first)
+        {
+            Slot& slot = slots_[(pos + i) & mask_];
+            while(slot.seq.load(std::memory_order_acquire) != pos + i)
+            {
+                std::this_thread::yield();
+            }
+            new (slot.ptr()) T(std::move(*first));
+            slot.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    //队列空返回false
+    bool tryPop(T& item)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0)
+            {
+                if(head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    T* p = slot.ptr();
+                    item = std::move(*p);
+                    p->~T();
+                    slot.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //批量取出：从head往后数出连续的可读槽位(最多max个)，一次CAS在head上把它们全部拿走
+    //返回取出的数量，依次移动赋值到out开始的位置；生产者还没写完的槽位之后的元素留给下一次
+    template<typename Iter>
+    size_t tryPopBulk(Iter out, size_t max)
+    {
+        if(max == 0) return 0;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        size_t n = 0;
+        for(;;)
+        {
+            n = 0;
+            while(n < max && slots_[(pos + n) & mask_].seq.load(std::memory_order_acquire) == pos + n + 1)
+            {
+                n++;
+            }
+            if(n == 0)
+            {
+                //第一个槽位不可读：队列空，或者pos已经被别的消费者拿走
+                size_t head = head_.load(std::memory_order_relaxed);
+                if(head == pos) return 0;
+                pos = head;
+                continue;
+            }
+            //数出来的槽位在CAS成功前不会被别的消费者拿走，成功后也不会被生产者覆盖
+            if(head_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        for(size_t i = 0; i < n; i++, ++out)
+        {
+            Slot& slot = slots_[(pos + i) & mask_];
+            T* p = slot.ptr();
+            *out = std::move(*p);
+            p->~T();
+            slot.seq.store(pos + i + mask_ + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    //近似元素个数
+    size_t size() const
+    {
+        size_t t = tail_.load(std::memory_order_relaxed);
+        size_t h = head_.load(std::memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* ptr() { return std::launder(reinterpret_cast<T*>(storage)); }
+    };
+
+    alignas(64) std::atomic<size_t> head_; //消费者位置
+    alignas(64) std::atomic<size_t> tail_; //生产者位置
+    alignas(64) std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+};
+
+
+#endif
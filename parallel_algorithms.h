@@ -0,0 +1,308 @@
+#ifndef PARALLEL_ALGORITHMS_H
+#define PARALLEL_ALGORITHMS_H
+
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <optional>
+#include <iterator>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <utility>
+#include <exception>
+#include <cstddef>
+
+#include "improved_threadpool.h"
+
+
+/*
+ 建立在ThreadPool上的并行算法
+ 区间递归二分：右半边作为任务提交到线程池，当前线程继续处理左半边，
+ 左半边做完后如果右半边还没有被别的线程领走，就收回来自己做，只等待真正在别的线程上运行的部分
+ 所以在池内线程里嵌套调用也不会因为任务排在队列里而死锁
+ grain为叶子区间的最小长度，传0按线程数量自动计算
+*/
+
+//自动粒度下每个线程平均分到的叶子区间数量，多切几份让快的线程多拿
+const size_t PARALLEL_LEAVES_PER_THREAD = 8;
+//parallel_sort的叶子和归并的最小长度，太小的区间串行更快
+const size_t PARALLEL_SORT_GRAIN = 2048;
+
+
+//递归二分的核心：leaf(begin, end)计算叶子区间的结果，join(left, right)合并相邻两段的结果
+template<typename T, typename Leaf, typename Join>
+class ParallelSplitter
+{
+public:
+    ParallelSplitter(ThreadPool& pool, size_t grain, Leaf& leaf, Join& join)
+        :pool_(pool)
+        ,grain_(grain)
+        ,leaf_(leaf)
+        ,join_(join)
+    {}
+
+    T run(size_t begin, size_t end)
+    {
+        if(end - begin <= grain_)
+        {
+            return leaf_(begin, end);
+        }
+
+        size_t mid = begin + (end - begin) / 2;
+        //右半边由谁执行：提交的任务和当前线程抢这个标记，抢到的执行
+        //当前线程抢到时任务稍后运行会直接返回，不再访问this
+        auto claimed = std::make_shared<std::atomic<bool>>(false);
+        Future<std::optional<T>> right = pool_.submitTask([this, claimed, mid, end]()->std::optional<T>
+        {
+            if(claimed->exchange(true, std::memory_order_acq_rel)) return std::nullopt;
+            return run(mid, end);
+        });
+
+        std::optional<T> left;
+        try
+        {
+            left.emplace(run(begin, mid));
+        }
+        catch(...)
+        {
+            //右半边可能正在别的线程上使用leaf_，等它结束再把异常抛出去
+            if(claimed->exchange(true, std::memory_order_acq_rel)) right.wait();
+            throw;
+        }
+
+        if(!claimed->exchange(true, std::memory_order_acq_rel))
+        {
+            //右半边还在队列里(或者提交被拒绝)，自己做
+            return join_(std::move(*left), run(mid, end));
+        }
+        return join_(std::move(*left), std::move(*right.get()));
+    }
+
+private:
+    ThreadPool& pool_;
+    size_t grain_;
+    Leaf& leaf_;
+    Join& join_;
+};
+
+//n个元素的区间按线程数量计算的叶子长度，grain不为0时直接使用
+inline size_t parallelGrain(ThreadPool& pool, size_t n, size_t grain)
+{
+    if(grain > 0) return grain;
+    size_t threads = (size_t)std::max(1, pool.threadCount());
+    return std::max<size_t>(1, n / (threads * PARALLEL_LEAVES_PER_THREAD));
+}
+
+template<typename T, typename Leaf, typename Join>
+T parallelSplit(ThreadPool& pool, size_t begin, size_t end, size_t grain, Leaf leaf, Join join)
+{
+    ParallelSplitter<T, Leaf, Join> splitter(pool, parallelGrain(pool, end - begin, grain), leaf, join);
+    return splitter.run(begin, end);
+}
+
+//parallel_for没有结果，叶子和合并都返回这个空类型
+struct ParallelUnit {};
+
+
+//对[first, last)中的每个下标i执行fn(i)
+template<typename F>
+void parallel_for(ThreadPool& pool, size_t first, size_t last, size_t grain, F&& fn)
+{
+    if(first >= last) return;
+    parallelSplit<ParallelUnit>(pool, first, last, grain,
+        [&fn](size_t b, size_t e)
+        {
+            for(size_t i = b; i < e; i++) fn(i);
+            return ParallelUnit();
+        },
+        [](ParallelUnit, ParallelUnit){ return ParallelUnit(); });
+}
+
+template<typename F>
+void parallel_for(ThreadPool& pool, size_t first, size_t last, F&& fn)
+{
+    parallel_for(pool, first, last, 0, std::forward<F>(fn));
+}
+
+
+//对[first, last)中的每个下标计算map(i)，再用combine归约，combine需要满足结合律
+//identity是combine的单位元，每个叶子从它开始累加
+template<typename T, typename Map, typename Combine>
+T parallel_reduce(ThreadPool& pool, size_t first, size_t last, size_t grain,
+    T identity, Map&& map, Combine&& combine)
+{
+    if(first >= last) return identity;
+    return parallelSplit<T>(pool, first, last, grain,
+        [&](size_t b, size_t e)
+        {
+            T acc = identity;
+            for(size_t i = b; i < e; i++) acc = combine(std::move(acc), map(i));
+            return acc;
+        },
+        [&combine](T a, T b){ return combine(std::move(a), std::move(b)); });
+}
+
+
+//out[i] = fn(in[i])，输入输出都是随机访问迭代器，返回输出的末尾
+template<typename InIt, typename OutIt, typename F>
+OutIt parallel_transform(ThreadPool& pool, InIt first, InIt last, OutIt out, F&& fn, size_t grain = 0)
+{
+    size_t n = (size_t)std::distance(first, last);
+    parallel_for(pool, 0, n, grain, [&](size_t i)
+    {
+        out[i] = fn(first[i]);
+    });
+    return out + n;
+}
+
+
+//并行归并[a1, a2)和[b1, b2)到out：较长的一段取中点，在另一段里二分找到切分位置，两半分别归并
+//a段在原序列中位于b段之前，相等元素保持a在前
+template<typename It, typename OutIt, typename Compare>
+void parallelMerge(ThreadPool& pool, It a1, It a2, It b1, It b2, OutIt out, Compare& comp)
+{
+    size_t na = (size_t)(a2 - a1);
+    size_t nb = (size_t)(b2 - b1);
+    if(na + nb <= PARALLEL_SORT_GRAIN)
+    {
+        std::merge(std::make_move_iterator(a1), std::make_move_iterator(a2),
+            std::make_move_iterator(b1), std::make_move_iterator(b2), out, comp);
+        return;
+    }
+
+    It am, bm;
+    if(na >= nb)
+    {
+        am = a1 + na / 2;
+        bm = std::lower_bound(b1, b2, *am, comp);
+    }
+    else
+    {
+        bm = b1 + nb / 2;
+        am = std::upper_bound(a1, a2, *bm, comp);
+    }
+    OutIt outMid = out + ((am - a1) + (bm - b1));
+
+    //两半互不重叠，拆成两个区间交给parallel_for
+    parallel_for(pool, 0, 2, 1, [&](size_t half)
+    {
+        if(half == 0) parallelMerge(pool, a1, am, b1, bm, out, comp);
+        else parallelMerge(pool, am, a2, bm, b2, outMid, comp);
+    });
+}
+
+//对[first, last)归并排序，buf是同样长度的临时空间
+template<typename It, typename BufIt, typename Compare>
+void parallelMergeSort(ThreadPool& pool, It first, It last, BufIt buf, size_t grain, Compare& comp)
+{
+    size_t n = (size_t)(last - first);
+    if(n <= grain)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    size_t half = n / 2;
+    parallel_for(pool, 0, 2, 1, [&](size_t part)
+    {
+        if(part == 0) parallelMergeSort(pool, first, first + half, buf, grain, comp);
+        else parallelMergeSort(pool, first + half, last, buf + half, grain, comp);
+    });
+
+    //归并到buf，再并行搬回原位置
+    parallelMerge(pool, first, first + half, first + half, last, buf, comp);
+    parallel_for(pool, 0, n, grain, [&](size_t i)
+    {
+        first[i] = std::move(buf[i]);
+    });
+}
+
+//并行排序(不稳定)，迭代器需要随机访问，元素需要可移动
+template<typename It, typename Compare>
+void parallel_sort(ThreadPool& pool, It first, It last, Compare comp)
+{
+    using Value = typename std::iterator_traits<It>::value_type;
+    size_t n = (size_t)(last - first);
+    size_t threads = (size_t)std::max(1, pool.threadCount());
+    size_t grain = std::max(PARALLEL_SORT_GRAIN, n / (threads * PARALLEL_LEAVES_PER_THREAD));
+    if(n <= grain)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    //临时空间从原序列移动构造，不要求元素可默认构造，排序过程中会被整体覆盖
+    std::vector<Value> buf(std::make_move_iterator(first), std::make_move_iterator(last));
+    parallel_for(pool, 0, n, grain, [&](size_t i)
+    {
+        first[i] = std::move(buf[i]);
+    });
+    parallelMergeSort(pool, first, last, buf.begin(), grain, comp);
+}
+
+template<typename It>
+void parallel_sort(ThreadPool& pool, It first, It last)
+{
+    parallel_sort(pool, first, last, std::less<typename std::iterator_traits<It>::value_type>());
+}
+
+
+//包含式前缀和：out[i] = in[0] op in[1] op ... op in[i]，op需要满足结合律
+//两遍：先并行求每块的和，串行算出每块的前缀，再并行对每块做带前缀的扫描
+template<typename InIt, typename OutIt, typename Op>
+OutIt parallel_inclusive_scan(ThreadPool& pool, InIt first, InIt last, OutIt out, Op op, size_t grain = 0)
+{
+    using Value = typename std::iterator_traits<InIt>::value_type;
+    size_t n = (size_t)std::distance(first, last);
+    if(n == 0) return out;
+
+    size_t block = parallelGrain(pool, n, grain);
+    size_t blocks = (n + block - 1) / block;
+    if(blocks == 1)
+    {
+        return std::partial_sum(first, last, out, op);
+    }
+
+    //第一遍：每块的和，最后一块用不到
+    std::vector<std::optional<Value>> sums(blocks);
+    parallel_for(pool, 0, blocks - 1, 1, [&](size_t k)
+    {
+        size_t b = k * block;
+        size_t e = b + block;
+        Value acc = first[b];
+        for(size_t i = b + 1; i < e; i++) acc = op(std::move(acc), first[i]);
+        sums[k].emplace(std::move(acc));
+    });
+
+    //块前缀：sums[k]变成前k+1块的总和
+    for(size_t k = 1; k + 1 < blocks; k++)
+    {
+        sums[k].emplace(op(*sums[k - 1], std::move(*sums[k])));
+    }
+
+    //第二遍：每块从前一块的累计和开始扫描
+    parallel_for(pool, 0, blocks, 1, [&](size_t k)
+    {
+        size_t b = k * block;
+        size_t e = std::min(n, b + block);
+        Value acc = k == 0 ? Value(first[b]) : op(*sums[k - 1], first[b]);
+        out[b] = acc;
+        for(size_t i = b + 1; i < e; i++)
+        {
+            acc = op(std::move(acc), first[i]);
+            out[i] = acc;
+        }
+    });
+    return out + n;
+}
+
+template<typename InIt, typename OutIt>
+OutIt parallel_inclusive_scan(ThreadPool& pool, InIt first, InIt last, OutIt out)
+{
+    return parallel_inclusive_scan(pool, first, last, out, std::plus<typename std::iterator_traits<InIt>::value_type>());
+}
+
+
+#endif
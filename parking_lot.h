@@ -0,0 +1,162 @@
+#ifndef PARKING_LOT_H
+#define PARKING_LOT_H
+
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+
+//每个工作线程一个的停车位(二值信号量)
+//unpark先于park发生时令牌会保留，下一次park直接返回，不会丢失唤醒
+class Parker
+{
+public:
+    Parker():token_(false){}
+
+    void park()
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        cond_.wait(lock, [&]()->bool{ return token_; });
+        token_ = false;
+    }
+
+    //超时返回false
+    template<typename Rep, typename Period>
+    bool parkFor(const std::chrono::duration<Rep, Period>& dur)
+    {
+        std::unique_lock<std::mutex> lock(mtx_);
+        bool woken = cond_.wait_for(lock, dur, [&]()->bool{ return token_; });
+        token_ = false;
+        return woken;
+    }
+
+    //在锁内通知：被唤醒的线程拿到锁之前这里已经不再访问Parker，它可以安全析构
+    void unpark()
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        token_ = true;
+        cond_.notify_one();
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    bool token_;
+};
+
+
+//空闲线程登记表
+//提交者只在没有线程正在自旋找任务时，才从登记表里取出一个挂起的线程唤醒，避免notify_all惊群
+//线程挂起的流程：enroll登记 -> 再检查一次队列 -> 没任务才park，有任务就cancel
+class ParkingLot
+{
+public:
+    ParkingLot()
+        :parkedSize_(0)
+        ,spinningSize_(0)
+    {}
+
+    //进入/退出自旋找任务的状态，endSpin返回自己是否是最后一个自旋的线程
+    void beginSpin() { spinningSize_++; }
+    bool endSpin() { return --spinningSize_ == 0; }
+
+    int spinning() const { return spinningSize_; }
+    int parked() const { return parkedSize_; }
+
+    //登记为空闲，调用后必须再检查一次是否有任务
+    void enroll(Parker* p)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        idle_.push_back(p);
+        parkedSize_++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    //取消登记，返回false说明已经被提交者取出并唤醒，令牌会在下次park时消耗掉
+    bool cancel(Parker* p)
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = std::find(idle_.begin(), idle_.end(), p);
+        if(it == idle_.end()) return false;
+        idle_.erase(it);
+        parkedSize_--;
+        return true;
+    }
+
+    //有线程在自旋就不唤醒，它会拿到任务；否则唤醒一个挂起的线程
+    void notifyOne()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(spinningSize_ > 0 || parkedSize_ == 0) return;
+        wake(1);
+    }
+
+    //唤醒最多n个挂起的线程，返回实际唤醒的数量
+    int wake(int n)
+    {
+        Parker* batch[16];
+        int woken = 0;
+        while(woken < n)
+        {
+            int cnt = 0;
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                while(cnt < 16 && woken + cnt < n && !idle_.empty())
+                {
+                    batch[cnt++] = idle_.back();
+                    idle_.pop_back();
+                    parkedSize_--;
+                }
+            }
+            if(cnt == 0) break;
+            for(int i = 0; i < cnt; i++)
+            {
+                batch[i]->unpark();
+            }
+            woken += cnt;
+        }
+        return woken;
+    }
+
+    //唤醒挂起最久的一个线程，缩容时让它退出，最近挂起的线程缓存还是热的，留着接任务
+    bool wakeOldest()
+    {
+        Parker* p = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if(idle_.empty()) return false;
+            p = idle_.front();
+            idle_.erase(idle_.begin());
+            parkedSize_--;
+        }
+        p->unpark();
+        return true;
+    }
+
+    void wakeAll()
+    {
+        std::vector<Parker*> all;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            all.swap(idle_);
+            parkedSize_ = 0;
+        }
+        for(Parker* p : all)
+        {
+            p->unpark();
+        }
+    }
+
+private:
+    std::mutex mtx_;
+    std::vector<Parker*> idle_; //后进先出，最近挂起的线程缓存最热
+    std::atomic_int parkedSize_;
+    std::atomic_int spinningSize_;
+};
+
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef POOL_GROUP_H
+#define POOL_GROUP_H
+
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "improved_threadpool.h"
+
+
+//子池的空闲线程借给其他子池的方式
+enum class LendPolicy
+{
+    LEND_NONE, //空闲线程只等本池的任务，适合延迟敏感的子池，来了任务总有线程可用
+    LEND_WHEN_IDLE, //空闲线程挂起前帮有排队任务的子池执行任务
+    LEND_WHEN_SATURATED, //只帮自己没有空闲线程、排队任务达到lendBacklog的子池
+};
+
+//子池的配置；没有列出的设置(空闲策略、批量取任务、统计回调等)在configure里直接调用ThreadPool的接口
+struct SubPoolOptions
+{
+    PoolMode mode = PoolMode::MODE_FIXED;
+    int threads = (int)std::thread::hardware_concurrency(); //初始线程数，cached模式下是最少线程数
+    int maxThreads = 0; //cached模式的线程上限，0使用线程池的默认值
+    int queueLimit = TASK_MAX_THRESHHOLD;
+    SubmitPolicy submitPolicy = SubmitPolicy::POLICY_BLOCK;
+    AffinityPolicy affinity = AffinityPolicy::AFFINITY_NONE;
+    std::vector<int> cpus; //AFFINITY_EXPLICIT的cpu列表
+    LendPolicy lend = LendPolicy::LEND_NONE;
+    int lendKeepIdle = 0; //借出时本池至少留下的空闲线程数，不算正在借出的这个
+    int lendBacklog = 1; //LEND_WHEN_SATURATED下借入方排队的任务达到这个数才帮忙
+    bool acceptLoans = true; //是否接受其他子池借出的线程
+    std::function<void(ThreadPool&)> configure; //start之前调用
+};
+
+
+/*
+ 线程池组：一个进程里cpu密集、阻塞io、延迟敏感的任务各自放进一个命名的子池，模式、线程数、绑核和队列上限互不影响
+ 子池就是普通的ThreadPool，提交、future、关闭方式都一样；组只负责配置、启动、关闭和子池之间借用线程
+ 借用：借出方的空闲线程挂起前帮接受借用的子池执行一个排队任务，然后回到本池重新找
+   借入方提交时自己没有空闲线程，叫醒一个借出方挂起的线程来帮忙
+ 先addPool全部子池再start，启动后子池的集合不再变化，借用时不用加锁
+*/
+class PoolGroup
+{
+public:
+    PoolGroup()
+        :started_(false)
+    {}
+
+    PoolGroup(const PoolGroup&) = delete;
+    PoolGroup& operator=(const PoolGroup&) = delete;
+
+    //先关闭全部子池再销毁，借出线程上的任务执行完之前子池都还在
+    ~PoolGroup()
+    {
+        shutdown();
+    }
+
+    //添加一个子池，返回它的线程池，start之后才启动；名字重复或者组已经启动时抛出异常
+    ThreadPool& addPool(const std::string& name, SubPoolOptions options)
+    {
+        if(started_)
+        {
+            throw std::logic_error("pool group already started, cannot add pool " + name);
+        }
+        if(find(name) != nullptr)
+        {
+            throw std::invalid_argument("duplicate pool name " + name);
+        }
+        auto sub = std::make_unique<SubPool>();
+        sub->name = name;
+        sub->options = std::move(options);
+        sub->pool = std::make_unique<ThreadPool>();
+        pools_.push_back(std::move(sub));
+        return *pools_.back()->pool;
+    }
+
+    //按配置设置并启动全部子池，设置了借用的子池装上借出和叫醒的回调
+    void start()
+    {
+        if(started_) return;
+        started_ = true;
+        for(size_t i = 0; i < pools_.size(); i++)
+        {
+            SubPool& sub = *pools_[i];
+            const SubPoolOptions& opt = sub.options;
+            ThreadPool& pool = *sub.pool;
+            pool.setMode(opt.mode);
+            pool.setTaskQueMaxThreshHold(opt.queueLimit);
+            pool.setSubmitPolicy(opt.submitPolicy);
+            pool.setAffinity(opt.affinity, opt.cpus);
+            if(opt.maxThreads > 0)
+            {
+                pool.setThreadSizeThreshHold(opt.maxThreads);
+            }
+            if(opt.lend != LendPolicy::LEND_NONE)
+            {
+                pool.setIdleWork([this, i](){ return lend(i); });
+            }
+            if(opt.acceptLoans)
+            {
+                pool.setBacklogCallback([this, i](){ callLender(i); });
+            }
+            if(opt.configure)
+            {
+                opt.configure(pool);
+            }
+            pool.start(opt.threads);
+        }
+    }
+
+    //按名字找子池，没有时抛出std::out_of_range；提交很频繁时保存返回的引用，不用每次查找
+    ThreadPool& pool(const std::string& name)
+    {
+        ThreadPool* pool = find(name);
+        if(pool == nullptr)
+        {
+            throw std::out_of_range("no pool named " + name);
+        }
+        return *pool;
+    }
+
+    //提交到名字对应的子池
+    template<typename Func, typename... Args>
+    auto submitTask(const std::string& name, Func&& func, Args&&... args) -> Future<decltype(func(args...))>
+    {
+        return pool(name).submitTask(std::forward<Func>(func), std::forward<Args>(args)...);
+    }
+
+    //按添加的顺序关闭全部子池；借出线程看到借入方已经关闭就不再帮它
+    void shutdown(ShutdownMode mode = ShutdownMode::SHUTDOWN_DRAIN)
+    {
+        for(auto& sub : pools_)
+        {
+            sub->pool->shutdown(mode);
+        }
+    }
+
+    size_t size() const
+    {
+        return pools_.size();
+    }
+
+private:
+    struct SubPool
+    {
+        std::string name;
+        SubPoolOptions options;
+        std::unique_ptr<ThreadPool> pool;
+        std::atomic<unsigned> cursor{0}; //借出时从哪个子池开始看，轮流帮各个子池
+    };
+
+    ThreadPool* find(const std::string& name)
+    {
+        for(auto& sub : pools_)
+        {
+            if(sub->name == name) return sub->pool.get();
+        }
+        return nullptr;
+    }
+
+    //lender的借用策略下borrower需不需要帮忙
+    static bool wantsHelp(const SubPoolOptions& lender, const ThreadPool& borrower)
+    {
+        int queued = borrower.queuedTasks();
+        if(lender.lend == LendPolicy::LEND_WHEN_IDLE)
+        {
+            return queued > 0;
+        }
+        return queued >= lender.lendBacklog && borrower.idleThreadCount() <= 0;
+    }
+
+    //在第self个子池的空闲工作线程上调用：帮一个需要帮忙的子池执行一个任务
+    bool lend(size_t self)
+    {
+        SubPool& me = *pools_[self];
+        //空闲线程数包括正在借出的这个线程
+        if(me.pool->idleThreadCount() <= me.options.lendKeepIdle) return false;
+        size_t n = pools_.size();
+        size_t first = me.cursor.fetch_add(1, std::memory_order_relaxed);
+        for(size_t k = 0; k < n; k++)
+        {
+            size_t j = (first + k) % n;
+            if(j == self) continue;
+            SubPool& other = *pools_[j];
+            if(!other.options.acceptLoans || !wantsHelp(me.options, *other.pool)) continue;
+            if(other.pool->runLentTask()) return true;
+        }
+        return false;
+    }
+
+    //第self个子池提交时没有空闲线程：叫醒一个愿意帮它的子池里挂起的线程
+    void callLender(size_t self)
+    {
+        ThreadPool& borrower = *pools_[self]->pool;
+        for(size_t j = 0; j < pools_.size(); j++)
+        {
+            SubPool& other = *pools_[j];
+            if(j == self || other.options.lend == LendPolicy::LEND_NONE) continue;
+            if(!wantsHelp(other.options, borrower)) continue;
+            if(other.pool->idleThreadCount() <= other.options.lendKeepIdle) continue;
+            if(other.pool->wakeIdleWorker()) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<SubPool>> pools_;
+    bool started_;
+};
+
+
+#endif
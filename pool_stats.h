@@ -0,0 +1,129 @@
+#ifndef POOL_STATS_H
+#define POOL_STATS_H
+
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+//直方图的桶数：桶0是0ns，桶i(i>=1)是[2^(i-1), 2^i)ns，最后一个桶收纳更长的时间
+const int STATS_HISTOGRAM_BUCKETS = 40;
+
+inline uint64_t statsNowNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+//按2的幂分桶的耗时直方图，读统计时得到的快照
+struct StatsHistogram
+{
+    uint64_t counts[STATS_HISTOGRAM_BUCKETS] = {};
+
+    static int bucketOf(uint64_t ns)
+    {
+        if(ns == 0) return 0;
+        int bucket = 64 - __builtin_clzll(ns);
+        return bucket < STATS_HISTOGRAM_BUCKETS ? bucket : STATS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    uint64_t total() const
+    {
+        uint64_t sum = 0;
+        for(uint64_t c : counts) sum += c;
+        return sum;
+    }
+
+    //分位数的估计值，返回所在桶的上界，没有样本时为0
+    std::chrono::nanoseconds percentile(double p) const
+    {
+        uint64_t n = total();
+        if(n == 0) return std::chrono::nanoseconds(0);
+        uint64_t rank = (uint64_t)(p * (double)(n - 1)) + 1;
+        uint64_t seen = 0;
+        for(int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+        {
+            seen += counts[i];
+            if(seen >= rank)
+            {
+                return std::chrono::nanoseconds(i == 0 ? 0 : (int64_t)1 << i);
+            }
+        }
+        return std::chrono::nanoseconds((int64_t)1 << (STATS_HISTOGRAM_BUCKETS - 1));
+    }
+};
+
+
+//ThreadPool::stats()的结果，各工作线程的计数器在读取时汇总
+struct PoolStats
+{
+    int threads = 0; //当前线程数量
+    int idleThreads = 0; //空闲线程数量
+    int queuedTasks = 0; //已提交还没开始执行的任务(队列深度)
+    int blockedThreads = 0; //在阻塞区域里的工作线程
+    int spareThreads = 0; //为阻塞区域临时补充的线程
+    uint64_t tasksExecuted = 0;
+    uint64_t tasksStolen = 0; //工作窃取模式下从其他线程的本地队列窃取执行的任务
+    uint64_t tasksRejected = 0; //队列满提交失败的任务
+    uint64_t tasksExpired = 0; //截止时间已过没有执行的任务
+    uint64_t tasksBorrowed = 0; //由线程池组里别的线程池借出的线程执行的任务
+    uint64_t idleSpinHits = 0; //工作线程空闲后在自旋期间取到任务的次数
+    uint64_t idleParks = 0; //工作线程空闲后挂起的次数，和idleSpinHits一起用来调整自旋次数
+    uint64_t threadsCreated = 0; //包括启动时创建的线程和cached模式下增加的线程
+    uint64_t threadsReclaimed = 0; //cached模式下缩容回收的线程和阻塞区域结束后退出的补偿线程
+    std::chrono::nanoseconds busyTime{0}; //所有线程执行任务的时间之和
+    std::chrono::nanoseconds idleTime{0}; //所有线程找不到任务(自旋和挂起)的时间之和
+    StatsHistogram queueWait; //从提交到开始执行
+    StatsHistogram runTime; //任务执行时间
+};
+
+
+//每个工作线程一份计数器，独占缓存行，只有拥有它的线程写，读统计时其他线程只读
+//只有一个写者，递增用load+store而不是带lock前缀的fetch_add
+struct alignas(64) WorkerStats
+{
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> busyNs{0};
+    std::atomic<uint64_t> idleNs{0};
+    std::atomic<uint64_t> spinHits{0};
+    std::atomic<uint64_t> parks{0};
+    std::atomic<uint64_t> queueWait[STATS_HISTOGRAM_BUCKETS] = {};
+    std::atomic<uint64_t> runTime[STATS_HISTOGRAM_BUCKETS] = {};
+    bool inUse = false; //被某个线程占用，线程退出后留给新线程继续累加，只在线程池的锁内访问
+
+    static void add(std::atomic<uint64_t>& counter, uint64_t n)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    //waitNs为0表示任务没有入队时间
+    //nested是等待future时帮忙执行的任务，执行时间已经包含在外层任务里，不再计入busyNs
+    void recordTask(uint64_t waitNs, uint64_t runNs, bool nested = false)
+    {
+        add(executed, 1);
+        if(!nested) add(busyNs, runNs);
+        add(runTime[StatsHistogram::bucketOf(runNs)], 1);
+        if(waitNs != 0) add(queueWait[StatsHistogram::bucketOf(waitNs)], 1);
+    }
+
+    void mergeInto(PoolStats& stats) const
+    {
+        stats.tasksExecuted += executed.load(std::memory_order_relaxed);
+        stats.tasksStolen += stolen.load(std::memory_order_relaxed);
+        stats.busyTime += std::chrono::nanoseconds(busyNs.load(std::memory_order_relaxed));
+        stats.idleTime += std::chrono::nanoseconds(idleNs.load(std::memory_order_relaxed));
+        stats.idleSpinHits += spinHits.load(std::memory_order_relaxed);
+        stats.idleParks += parks.load(std::memory_order_relaxed);
+        for(int i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+        {
+            stats.queueWait.counts[i] += queueWait[i].load(std::memory_order_relaxed);
+            stats.runTime.counts[i] += runTime[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef STRAND_H
+#define STRAND_H
+
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <thread>
+#include <utility>
+
+#include "task_function.h"
+#include "future.h"
+
+
+const int STRAND_BATCH = 64; //排空任务一次最多连续执行的任务数，之后把剩下的重新排队，让出工作线程
+
+
+/*
+ 串行执行器的共享状态：投递到同一个strand的任务按FIFO顺序一个接一个执行，同一时刻最多占用一个工作线程
+ 任务挂在无锁的多生产者单消费者链表上(Vyukov)，节点从内存池分配
+ pending_从0变成1的投递者负责把一个"排空"任务交给执行器，排空任务执行到pending_回到0为止
+ 空闲的strand不占线程，也没有定时器
+*/
+class StrandState : public std::enable_shared_from_this<StrandState>
+{
+public:
+    StrandState(FutureExecutor* executor, StatePool* memory)
+        :executor_(executor)
+        ,memory_(memory)
+        ,head_(&stub_)
+        ,tail_(&stub_)
+        ,pending_(0)
+    {}
+
+    StrandState(const StrandState&) = delete;
+    StrandState& operator=(const StrandState&) = delete;
+
+    //排空任务持有共享状态，析构时队列一定是空的
+    ~StrandState() = default;
+
+    void post(TaskFunc&& task)
+    {
+        Node* node = new (memory_->allocate(sizeof(Node), alignof(Node))) Node(std::move(task));
+        push(node);
+        if(pending_.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            schedule();
+        }
+    }
+
+    //当前线程是不是正在执行这个strand的任务
+    bool runningInThisThread() const
+    {
+        return currentStrand() == this;
+    }
+
+    FutureExecutor* executor() const { return executor_; }
+    StatePool* memory() const { return memory_; }
+
+private:
+    struct Node
+    {
+        Node() = default;
+        explicit Node(TaskFunc&& t) : task(std::move(t)) {}
+
+        TaskFunc task;
+        std::atomic<Node*> next{nullptr};
+    };
+
+    static const StrandState*& currentStrand()
+    {
+        static thread_local const StrandState* strand = nullptr;
+        return strand;
+    }
+
+    //执行器队列满或已经停止时，排空任务在投递者的线程上直接执行
+    void schedule()
+    {
+        executor_->execute(TaskFunc([self = shared_from_this()]()
+        {
+            self->drain();
+        }));
+    }
+
+    //帮忙等待future时可能在别的strand的任务里嵌套执行，退出时恢复外层的当前strand
+    void drain()
+    {
+        const StrandState* outer = currentStrand();
+        currentStrand() = this;
+        for(int i = 0; i < STRAND_BATCH; i++)
+        {
+            Node* node = pop();
+            node->task();
+            node->~Node();
+            memory_->deallocate(node, sizeof(Node), alignof(Node));
+            if(pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                currentStrand() = outer;
+                return;
+            }
+        }
+        currentStrand() = outer;
+        //还有任务，重新排队，执行器上其他任务有机会先执行；pending_没有回到0，不会有第二个排空任务
+        schedule();
+    }
+
+    void push(Node* node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    //只有排空任务调用；pending_大于0时一定有节点，投递者交换了head_但还没连上next的短暂窗口里让出cpu再试
+    Node* pop()
+    {
+        for(;;)
+        {
+            Node* node = tryPop();
+            if(node != nullptr) return node;
+            std::this_thread::yield();
+        }
+    }
+
+    Node* tryPop()
+    {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if(tail == &stub_)
+        {
+            if(next == nullptr) return nullptr;
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if(next != nullptr)
+        {
+            tail_ = next;
+            return tail;
+        }
+        if(tail != head_.load(std::memory_order_acquire)) return nullptr;
+        //tail是最后一个节点，把stub放回去，tail才有后继可以移走
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if(next != nullptr)
+        {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    FutureExecutor* executor_;
+    StatePool* memory_;
+    Node stub_;
+    alignas(64) std::atomic<Node*> head_; //投递者交换的一端
+    alignas(64) Node* tail_; //只有排空任务访问
+    std::atomic<size_t> pending_; //已经投递、还没执行完的任务数
+};
+
+
+//strand的句柄，可以复制，副本共享同一个队列；同一个strand的任务不需要再用互斥锁保护它们共享的数据
+//例如每个连接一个strand，这个连接的读写处理按顺序执行，不同连接之间并行
+//strand的任务里不要等待同一个strand后面的任务，它们要等当前任务返回才会开始
+class Strand
+{
+public:
+    explicit Strand(FutureExecutor& executor, StatePool* memory = StatePool::global())
+        :state_(std::make_shared<StrandState>(&executor, memory))
+    {}
+
+    //投递到strand，返回结果的future；任务按投递顺序执行，前一个返回后才开始下一个
+    template<typename Func, typename... Args>
+    auto submitTask(Func&& func, Args&&... args) -> Future<decltype(func(args...))>
+    {
+        using RType = decltype(func(args...));
+        Promise<RType> promise(state_->memory(), state_->executor());
+        Future<RType> result = promise.getFuture();
+        state_->post(TaskFunc([promise = std::move(promise),
+            func = std::forward<Func>(func),
+            args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        {
+            promise.setFromCall([&]()->RType{ return std::apply(func, args); });
+        }));
+        return result;
+    }
+
+    bool runningInThisThread() const
+    {
+        return state_->runningInThisThread();
+    }
+
+private:
+    std::shared_ptr<StrandState> state_;
+};
+
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef TASK_FUNCTION_H
+#define TASK_FUNCTION_H
+
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+
+//只能移动的void()可调用对象包装，替代std::function<void()>
+//不超过INLINE_SIZE字节且移动不抛异常的可调用对象直接存放在对象内部，不需要堆分配
+class TaskFunc
+{
+public:
+    static constexpr size_t INLINE_SIZE = 48;
+
+    TaskFunc() noexcept : ops_(nullptr), stamp_(0) {}
+    TaskFunc(std::nullptr_t) noexcept : ops_(nullptr), stamp_(0) {}
+
+    template<typename F,
+        typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TaskFunc>::value>::type>
+    TaskFunc(F&& f)
+        :ops_(nullptr)
+        ,stamp_(0)
+    {
+        using Fn = typename std::decay<F>::type;
+        if constexpr(fitsInline<Fn>())
+        {
+            new (storage_) Fn(std::forward<F>(f));
+            ops_ = &inlineOps<Fn>;
+        }
+        else
+        {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(f));
+            ops_ = &heapOps<Fn>;
+        }
+    }
+
+    TaskFunc(TaskFunc&& other) noexcept
+        :ops_(other.ops_)
+        ,stamp_(other.stamp_)
+    {
+        if(ops_ != nullptr)
+        {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    TaskFunc& operator=(TaskFunc&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            stamp_ = other.stamp_;
+            if(other.ops_ != nullptr)
+            {
+                other.ops_->move(storage_, other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    TaskFunc(const TaskFunc&) = delete;
+    TaskFunc& operator=(const TaskFunc&) = delete;
+
+    ~TaskFunc() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+    bool operator==(std::nullptr_t) const noexcept { return ops_ == nullptr; }
+    bool operator!=(std::nullptr_t) const noexcept { return ops_ != nullptr; }
+
+    //附带的时间戳，线程池记录入队时间用来统计排队时长，随对象一起移动
+    void setStamp(uint64_t stamp) noexcept { stamp_ = stamp; }
+    uint64_t stamp() const noexcept { return stamp_; }
+
+    //是否存放在内部缓冲区，用于测试和统计
+    bool isInline() const noexcept { return ops_ != nullptr && ops_->isInline; }
+
+    template<typename Fn>
+    static constexpr bool fitsInline()
+    {
+        return sizeof(Fn) <= INLINE_SIZE
+            && alignof(std::max_align_t) % alignof(Fn) == 0
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+private:
+    void reset() noexcept
+    {
+        if(ops_ != nullptr)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    //类型擦除的操作表，每种可调用类型一份静态实例
+    struct Ops
+    {
+        void (*invoke)(void*);
+        void (*move)(void* dst, void* src) noexcept;
+        void (*destroy)(void*) noexcept;
+        bool isInline;
+    };
+
+    template<typename Fn>
+    static void inlineInvoke(void* p) { (*static_cast<Fn*>(p))(); }
+    template<typename Fn>
+    static void inlineMove(void* dst, void* src) noexcept
+    {
+        Fn* s = static_cast<Fn*>(src);
+        new (dst) Fn(std::move(*s));
+        s->~Fn();
+    }
+    template<typename Fn>
+    static void inlineDestroy(void* p) noexcept { static_cast<Fn*>(p)->~Fn(); }
+
+    template<typename Fn>
+    static void heapInvoke(void* p) { (**static_cast<Fn**>(p))(); }
+    template<typename Fn>
+    static void heapMove(void* dst, void* src) noexcept
+    {
+        *static_cast<Fn**>(dst) = *static_cast<Fn**>(src);
+    }
+    template<typename Fn>
+    static void heapDestroy(void* p) noexcept { delete *static_cast<Fn**>(p); }
+
+    template<typename Fn>
+    static constexpr Ops inlineOps = { &inlineInvoke<Fn>, &inlineMove<Fn>, &inlineDestroy<Fn>, true };
+    template<typename Fn>
+    static constexpr Ops heapOps = { &heapInvoke<Fn>, &heapMove<Fn>, &heapDestroy<Fn>, false };
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+    const Ops* ops_;
+    uint64_t stamp_; //占用按max_align_t对齐后剩下的填充，不增加对象大小
+};
+
+
+#endif
@@ -17,6 +17,7 @@ ThreadPool::ThreadPool()
 ,idleThreadSize_(0)
 ,threadSizeThreshHold_(300)
 ,taskQueMaxThreshHold_(TASK_MAX_THRESHHOLD)
+,statePool_(StatePool::create())
 ,poolMode_(PoolMode::MODE_FIXED)
 ,isPoolRunning_(false)
 {}
@@ -26,11 +27,21 @@ ThreadPool::ThreadPool()
 //线程池析构
 ThreadPool::~ThreadPool()
 {
+    //在锁内修改运行状态再通知，工作线程检查状态和开始等待之间不会漏掉通知
+    std::unique_lock<std::mutex> lock(taskQueMtx_);
     isPoolRunning_ = false;
     notEmpty_.notify_all();
     //等待线程池所有线程返回  有两种状态：阻塞&正在执行任务
-    std::unique_lock<std::mutex> lock(taskQueMtx_);
     exitCond_.wait(lock, [&]()->bool{return threads_.size()== 0;});  //队列还有就阻塞
+    std::vector<std::unique_ptr<Thread>> exited;
+    exited.swap(retired_);
+    lock.unlock();
+    for(auto& thread : exited)
+    {
+        thread->join();
+    }
+    //还没取走的Result持有内存池的引用，内存池在它们都释放后才真正析构
+    statePool_->release();
 }
 
 
@@ -58,17 +69,28 @@ void ThreadPool::setThreadSizeThreshHold(int threshold){
    
  //给线程池提交任务，生产任务
 Result ThreadPool::submitTask(std::shared_ptr<Task> sp){
+    //先绑定结果再入队，工作线程执行任务时共享状态一定已经存在
+    Future<Any> future = sp->bindResult(statePool_);
+    if(!enqueueTask(sp))
+    {
+        //task执行完task对象就析构了，返回值不能放在task里，放在共享状态里
+        return Result(std::move(future), false);
+    }
+    return Result(std::move(future));
+}
+
+//任务放入队列，生产任务
+bool ThreadPool::enqueueTask(std::shared_ptr<Task> sp, bool wait){
     //生产者获取锁，任务队列是临界区
     std::unique_lock<std::mutex> lock(taskQueMtx_);
 
     //线程通信，等待任务队列有空间，size<task_max_threshold,否则条件变量阻塞并释放锁
-    //如果阻塞了一秒钟，返回任务提交失败
-    if(!notFull_.wait_for(lock,std::chrono::seconds(1),
-    [&]()->bool {return taskQue_.size()<(size_t)taskQueMaxThreshHold_ ;}));
+    //如果阻塞了一秒钟，返回任务提交失败；不等待时队列满直接失败
+    auto notFull = [&]()->bool {return taskQue_.size()<(size_t)taskQueMaxThreshHold_ ;};
+    if(wait ? !notFull_.wait_for(lock,std::chrono::seconds(1), notFull) : !notFull())
     {
         std::cerr<<"task queue is full , submit task failed"<<std::endl;
-        //return task->getResult(); //任务成员方法返回任务不可以：task执行完，task对象已经析构了
-        return Result(sp,false);
+        return false;
     }
     //wait(lock)  wait_for()  wait_until()  等到条件满足  
     //wait_for返回false，表示等1秒条件依然不满足
@@ -85,20 +107,43 @@ Result ThreadPool::submitTask(std::shared_ptr<Task> sp){
     //cached模式且任务数量大于空闲线程数量，且当前线程数量少于线程数量上限（根据机器来定）
     if(poolMode_ == PoolMode::MODE_CACHED && taskSize_ > idleThreadSize_ && curThreadSize_< threadSizeThreshHold_)
     {
-        //创建新线程
-        //创建线程对象的时候，把线程函数给到thread线程对象
-        auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
-        int threadId = ptr->getId();
-        threads_.emplace(threadId, std::move(ptr));
-        threads_[threadId]->start();
-        //修改线程数量相关变量
-        idleThreadSize_++;
-        //unique_ptr无左值的拷贝赋值
-        // threads_.emplace_back(std::move(ptr));
-        curThreadSize_++;
+        spawnThread();
     }
     
-    return Result(sp);
+    return true;
+}
+
+//调用时持有taskQueMtx_
+//先join已经回收的线程，retired_里的线程已经离开了临界区，马上就会返回
+void ThreadPool::spawnThread()
+{
+    for(auto& thread : retired_)
+    {
+        thread->join();
+    }
+    retired_.clear();
+    //创建新线程
+    //创建线程对象的时候，把线程函数给到thread线程对象
+    auto ptr = std::make_unique<Thread>(std::bind(&ThreadPool::threadFunc, this, std::placeholders::_1));
+    int threadId = ptr->getId();
+    threads_.emplace(threadId, std::move(ptr));
+    threads_[threadId]->start();
+    //修改线程数量相关变量
+    idleThreadSize_++;
+    //unique_ptr无左值的拷贝赋值
+    // threads_.emplace_back(std::move(ptr));
+    curThreadSize_++;
+}
+
+void ThreadPool::retireThread(int threadid)
+{
+    auto it = threads_.find(threadid);
+    if(it != threads_.end())
+    {
+        retired_.push_back(std::move(it->second));
+        threads_.erase(it);
+    }
+    exitCond_.notify_all();
 }
 
 //开启线程池
@@ -123,9 +168,9 @@ void ThreadPool::start(int initThreadSize)
     }
 
     //集中启动所有线程
-    for(int i = 0;i< initThreadSize_; i++)
+    for(auto& item : threads_)
     {
-        threads_[i]->start();
+        item.second->start();
         idleThreadSize_++; //每启动一个线程，空闲++
 
     }
@@ -135,6 +180,7 @@ void ThreadPool::start(int initThreadSize)
 void ThreadPool::threadFunc(int threadid)//线程函数返回，线程就结束了
 {
     auto lastTime = std::chrono::high_resolution_clock().now();
+    currentFutureHelper() = this; //在任务里等待Result时帮忙执行任务，线程退出后不再使用
     // std::cout<<"begin threadFunc tid:"<<std::this_thread::get_id()
     // <<std::endl;
     // std::cout<<"end threadFunc tid:"<<std::this_thread::get_id()
@@ -142,9 +188,7 @@ void ThreadPool::threadFunc(int threadid)//线程函数返回，线程就结束
     for(;;)
     {
         //先获取锁
-        std::unique_lock<std::mutex> lock(taskQue_);
-        std::cout<< "tid:" <<std::this_thread::get_id()
-        << "尝试获取任务" <<std::endl;
+        std::unique_lock<std::mutex> lock(taskQueMtx_);
 
         //cached模式下， 有可能已经创建了很多的线程，但是空闲时间超过60s应该回收多余的线程
         //超过initThreadsize的数量需要进行回收
@@ -154,9 +198,8 @@ void ThreadPool::threadFunc(int threadid)//线程函数返回，线程就结束
         {
             if(!isPoolRunning_)
             {
-                threads_.erase(threadid);  //std::this_thread::getid()
-                std::cout<<"threadid:"<<std::this_thread::get_id()<<"exit"<<std::endl;
-                exitCond_.notify_all();
+                retireThread(threadid);
+                currentFutureHelper() = nullptr;
                 return;
             }
 
@@ -172,11 +215,11 @@ void ThreadPool::threadFunc(int threadid)//线程函数返回，线程就结束
                     {
                         //回收当前线程
                         //线程数量相关变量的修改
-                        //把线程对象从线程列表容器中删除 通过线程id
-                        threads_.erase(threadid);  //std::this_thread::getid()
+                        //把线程对象从线程列表容器中移到retired_ 通过线程id，并通知析构函数
+                        retireThread(threadid);
                         curThreadSize_--;
                         idleThreadSize_--;
-                        std::cout<<"threadid:"<<std::this_thread::get_id()<<"exit"<<std::endl;
+                        currentFutureHelper() = nullptr;
                         return;
                         
                     }
@@ -201,18 +244,17 @@ void ThreadPool::threadFunc(int threadid)//线程函数返回，线程就结束
         //从wait返回
         idleThreadSize_--;
 
-        std::cout<< "tid:" <<std::this_thread::get_id()
-        <<  "获取任务成功......" <<std::endl;
         //从任务队列中取一个任务出来
         auto task = taskQue_.front();
         taskQue_.pop();
         taskSize_--;
+        bool hasMore = taskQue_.size() > 0;
         
         //访问临界区结束，应该释放锁
         lock.unlock(); 
         
         //如果依然有剩余任务，继续通知其他线程执行任务
-        if(taskQue_.size() > 0)
+        if(hasMore)
         {
             notEmpty_.notify_all();
         }
@@ -233,6 +275,46 @@ void ThreadPool::threadFunc(int threadid)//线程函数返回，线程就结束
 }
 
 
+//后续任务包装成Task放进任务队列；由完成前驱的线程调用，不能阻塞，放不进去就直接执行
+void ThreadPool::execute(TaskFunc&& task)
+{
+    //把TaskFunc包装成Task，结果已经由TaskFunc内部的Promise处理，不需要Result
+    class ContinuationTask : public Task
+    {
+    public:
+        ContinuationTask(TaskFunc&& func) : func_(std::move(func)) {}
+        void exec() override { func_(); }
+        Any run() override { func_(); return Any(); }
+    private:
+        TaskFunc func_;
+    };
+
+    auto sp = std::make_shared<ContinuationTask>(std::move(task));
+    if(!isPoolRunning_ || !enqueueTask(sp, false))
+    {
+        sp->exec();
+    }
+}
+
+//池内线程在Result::get()里等待时调用，队列空返回false，等待者短暂挂起后再来
+bool ThreadPool::helpOne()
+{
+    std::shared_ptr<Task> task;
+    {
+        std::lock_guard<std::mutex> lock(taskQueMtx_);
+        if(taskQue_.empty())
+        {
+            return false;
+        }
+        task = taskQue_.front();
+        taskQue_.pop();
+        taskSize_--;
+    }
+    notFull_.notify_all();
+    task->exec();
+    return true;
+}
+
 bool ThreadPool::checkRunningState()const
 {
     return isPoolRunning_;
@@ -246,8 +328,9 @@ Thread::Thread(ThreadFunc func)
 {}
 
 
+//线程池保证析构前线程已经退出或正在退出，不会在线程自己里面析构
 Thread::~Thread(){
-
+    join();
 }
 
 
@@ -261,56 +344,53 @@ int Thread::getId()const
 //启动线程
 void Thread::start()
 {
-    //创建一个线程来执行一个线程函数
-    std::thread t(func_);   //c++11线程对象 和线程函数func_
-    t.detach(); //设置分离线程 pthread_detach    phread_t设置成分离线程
+    //创建一个线程来执行一个线程函数，线程对象保存下来，由线程池join
+    thread_ = std::thread(func_, threadId_);   //c++11线程对象 和线程函数func_
+}
+
+void Thread::join()
+{
+    if(thread_.joinable()) thread_.join();
 }
 
 //////////Result方法的实现
-Result::Result(std::shared_ptr<Task> task, bool isValid)
-    :isvalid_(isValid)
-    ,task_(task)
+Result::Result(Future<Any> future, bool isValid)
+    :future_(std::move(future))
+    ,isvalid_(isValid)
     {
-
-        task_->setResult(this);
     }
 
 
 
 Any Result::get()  //用户调用
 {
-    if(!isvalid_)
+    if(!isvalid_ || !future_.valid())
     {
         return "";
     }
-    sem_.wait(); //任务如果没有执行完会阻塞用户线程  
-    //没有左值拷贝赋值和拷贝构造
-    return std::move(any_);
+    //任务如果没有执行完会阻塞用户线程，只能get一次
+    return future_.get();
 
 }
 
-void Result::setVal(Any any)  // 
-{
-    this->any_ = std::move(any);
-    sem_.post();
-}
-
 /////////Task类
-Task::Task(): result_(nullptr)
+Task::Task(): promise_(nullptr)
 {
 
 }
 
 void Task::exec()
 {
-    if(result_ != nullptr)
+    if(promise_.valid())
     {
-        result_->setVal(run());
+        //run抛出的异常会在Result::get中重新抛出
+        promise_.setFromCall([this]()->Any{ return run(); });
     }
     
 }
 
-void Task::setResult(Result* res)
+Future<Any> Task::bindResult(StatePool* pool)
 {
-    result_ = res;
-}
\ No newline at end of file
+    promise_ = Promise<Any>(pool);
+    return promise_.getFuture();
+}
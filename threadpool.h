@@ -11,6 +11,9 @@
 #include <functional>
 #include <unordered_map>
 #include <thread>
+#include <stdexcept>
+
+#include "future.h"
 
 
 
@@ -39,20 +42,28 @@ public:
     T cast_()
     {
         //我们怎么从base_找到它所指向的Derive对象，从它里面取出data成员变量
-        //基类指针-》派生类指针 RTTI
-        Derive<T> *pd = dynamic_cast<Derive<T>*>(base_.get());
-        if(pd == nullptr)
+        //比较每种类型唯一的标记地址，不需要RTTI和dynamic_cast
+        if(base_ == nullptr || base_->type() != typeTag<T>())
         {
             throw "type unmatch";
         }
-        return pd->data_;
+        return static_cast<Derive<T>*>(base_.get())->data_;
     }
 private:
+    //每种类型一个静态变量，用它的地址作为类型标记
+    template<typename T>
+    static const void* typeTag()
+    {
+        static const char tag = 0;
+        return &tag;
+    }
+
     //基类类型
     class Base
     {
     public:
-        virtual ~Base() = default; 
+        virtual ~Base() = default;
+        virtual const void* type() const = 0;
     };
 
     //派生类类型
@@ -60,9 +71,9 @@ private:
     class  Derive: public Base
     {        
     public:
-         Derive(T data): data_(data){};
+         Derive(T data): data_(std::move(data)){};
+         const void* type() const override { return typeTag<T>(); }
          T data_;
-         ~Derive();
     };
 private:
     //定义一个基类的指针
@@ -112,29 +123,28 @@ private:
 
 };
 
-//Task类型的前置声明
-class Task;
-
 //实现接收提交到线程池的task任务执行完成后的返回值类型result
+//结果存放在线程池内存池分配的共享状态里，Result和Task各持有一份引用，可以安全移动
 class Result
 {
 public:
-    Result(std::shared_ptr<Task> task, bool isvalid = true);
+    Result(Future<Any> future, bool isvalid = true);
     ~Result() = default;
+    Result(Result&&) = default;
+    Result& operator=(Result&&) = default;
 
-    //问题1：setval方法，获取任务执行完的返回值
-    void setVal(Any any);
-
-    //问题2：get方法，用户调用这个方法获取task的返回值
+    //get方法，用户调用这个方法获取task的返回值，任务没执行完先自旋一会再挂起
     Any get();
 
 private:
-    Any any_; //存储任务返回值
-    Semaphore sem_; //线程通信的信号量(与任务执行线程通信)
-    std::shared_ptr<Task> task_; //指向对应获取返回值的任务对象
-    std::atomic_bool isvalid_;  //返回值是否有效
+    Future<Any> future_; //任务返回值的共享状态
+    bool isvalid_;  //返回值是否有效
 };
 
+//返回值类型固定的Result：值直接存放在共享状态里，不经过Any的堆分配
+template<typename T>
+using TypedResult = Future<T>;
+
 
 //任务抽象基类
 class Task 
@@ -142,13 +152,66 @@ class Task
 public:
 //用户任务继承自该基类
     Task();
-    ~Task() =default;
-    void exec();
+    virtual ~Task() = default;
+    //在线程池线程中执行，把run的返回值(或异常)交给对应的Result
+    virtual void exec();
     virtual Any run()=0;
-    void setResult(Result* res);
+
+private:
+    friend class ThreadPool;
+    //提交时由线程池调用，创建和这个任务绑定的共享状态
+    Future<Any> bindResult(StatePool* pool);
+
+    Promise<Any> promise_;
+};
+
+
+//返回值类型固定的任务基类，用户实现call()，提交后得到TypedResult<T>
+//也可以当作普通Task提交，这时返回值装进Any
+template<typename T>
+class TypedTask : public Task
+{
+public:
+    using ResultType = T;
+
+    TypedTask() : typedPromise_(nullptr) {}
+
+    virtual T call() = 0;
+
+    void exec() override
+    {
+        if(typedPromise_.valid())
+        {
+            typedPromise_.setFromCall([this]()->T{ return call(); });
+        }
+        else
+        {
+            Task::exec();
+        }
+    }
+
+    Any run() override
+    {
+        if constexpr(std::is_void<T>::value)
+        {
+            call();
+            return Any();
+        }
+        else
+        {
+            return Any(call());
+        }
+    }
+
 private:
-    Result* result_;//result生命周期长于task   
+    friend class ThreadPool;
+    Future<T> bindTypedResult(StatePool* pool, FutureExecutor* executor)
+    {
+        typedPromise_ = Promise<T>(pool, executor);
+        return typedPromise_.getFuture();
+    }
 
+    Promise<T> typedPromise_;
 };
 
 //线程类型
@@ -158,6 +221,8 @@ public:
     //线程函数对象类型
     using ThreadFunc = std::function<void(int)>;
     void start();
+    //等线程函数返回，线程对象由线程池持有，不再detach
+    void join();
     int getId()const;
 
 
@@ -169,12 +234,15 @@ private:
    ThreadFunc func_;
    static int generateId_;
    int threadId_; //保存线程id
+   std::thread thread_;
      
 };
 
 
 
-class ThreadPool
+//线程池同时是TypedResult的FutureExecutor，then()的后续任务提交回线程池
+//也是工作线程的FutureHelper，任务里get()另一个任务的Result时帮忙执行队列里的任务
+class ThreadPool : public FutureExecutor, public FutureHelper
 {
 
 public:
@@ -194,6 +262,19 @@ public:
     //给线程池提交任务
     Result submitTask(std::shared_ptr<Task> sp);
 
+    //提交TypedTask<T>的派生类，返回类型化的结果
+    template<typename T, typename R = typename T::ResultType>
+    TypedResult<R> submitTask(std::shared_ptr<T> sp)
+    {
+        TypedResult<R> result = sp->bindTypedResult(statePool_, this);
+        if(!enqueueTask(sp))
+        {
+            setFutureException(result, std::make_exception_ptr(
+                std::runtime_error("task queue is full, submit task failed")));
+        }
+        return result;
+    }
+
     bool checkRunningState()const;
 
 
@@ -202,10 +283,23 @@ public:
 private:
     //定义线程函数
     void threadFunc(int threadid);
+    //线程退出前调用，持有taskQueMtx_：线程不能join自己，把线程对象移到retired_等别的线程join
+    void retireThread(int threadid);
+    //创建新线程
+    void spawnThread();
+    //任务放入队列，队列满等待超时返回false，wait为false时不等待
+    bool enqueueTask(std::shared_ptr<Task> sp, bool wait = true);
+    //FutureExecutor接口：TypedResult上then()/when_all()的后续任务从这里进入线程池
+    void execute(TaskFunc&& task) override;
+    //FutureHelper接口：池内线程等待Result时从任务队列取一个任务执行
+    //这个线程池没有补偿线程，嵌套超过FUTURE_HELP_MAX_DEPTH层后直接挂起
+    bool canHelp() override { return true; }
+    bool helpOne() override;
 
 private:
     // std::vector<std::unique_ptr<Thread>> threads_;//线程列表
     std::unordered_map<int, std::unique_ptr<Thread>> threads_; //线程列表
+    std::vector<std::unique_ptr<Thread>> retired_; //已经退出、还没有join的线程
     size_t initThreadSize_;  //初始的线程数量
     int threadSizeThreshHold_; //线程数量上限
     std::atomic_int  idleThreadSize_; //空闲线程的数量
@@ -216,6 +310,7 @@ private:
     std::queue<std::shared_ptr<Task>> taskQue_;//任务队列
     std::atomic_int  taskSize_;   //任务的数量
     int taskQueMaxThreshHold_;  //任务队列数量上限阈值
+    StatePool* statePool_; //Result共享状态的内存池
      
     std::mutex taskQueMtx_; //保证任务队列的线程安全
     std::condition_variable notFull_; //任务队列不满
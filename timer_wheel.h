@@ -0,0 +1,453 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "task_function.h"
+#include "future.h"
+
+
+const int TIMER_WHEEL_LEVELS = 4;
+const int TIMER_WHEEL_BITS = 8;
+const int TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS; //每层256个槽
+const int TIMER_TICK_US = 1000; //默认1ms一格，4层覆盖2^32格(约49天)，更远的到期时间先放在最高层，转到时重新放
+const size_t TIMER_CHUNK_NODES = 4096; //定时器节点按块分配，扩容时已有节点不移动
+
+
+//周期定时器每次到期提交给线程池的任务共享的部分
+//上一次还没执行完时跳过这一次，同一个周期任务不会并发执行；任务抛出异常后停止，不再触发
+struct PeriodicTimerJob
+{
+    explicit PeriodicTimerJob(TaskFunc&& fn) : fn(std::move(fn)), running(false), stopped(false) {}
+
+    void run()
+    {
+        if(stopped.load(std::memory_order_acquire) || running.exchange(true, std::memory_order_acquire)) return;
+        try
+        {
+            fn();
+        }
+        catch(...)
+        {
+            stopped.store(true, std::memory_order_release);
+        }
+        running.store(false, std::memory_order_release);
+    }
+
+    TaskFunc fn;
+    std::atomic<bool> running;
+    std::atomic<bool> stopped;
+};
+
+
+/*
+ 分层时间轮：4层，每层256个槽，第0层一格一个tick，第k层一格256^k个tick
+ 定时器挂在到期时间所在层的槽的双向链表上(用节点下标串起来)，插入和取消都是O(1)
+ 第0层转完一圈时把上一层当前槽里的定时器重新放一次(级联)，它们会落到更低的层
+ 节点按块分配，用下标和代数组成的id引用，节点复用后旧id失效，取消一个已经触发或已经取消的id返回false
+ 所有操作在内部的互斥锁下进行；到期的任务移出来交给调用者，在锁外提交或析构
+*/
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit TimerWheel(std::chrono::microseconds tick = std::chrono::microseconds(TIMER_TICK_US))
+        :tick_(std::max<std::chrono::microseconds>(tick, std::chrono::microseconds(1)))
+        ,start_(Clock::now())
+        ,next_(0)
+        ,size_(0)
+        ,freeHead_(NIL)
+    {
+        for(auto& level : slots_)
+        {
+            for(uint32_t& head : level) head = NIL;
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    //when到期后执行task；period大于0时是周期定时器，每隔period触发一次，直到取消
+    //返回取消用的id
+    uint64_t add(Clock::time_point when, TaskFunc&& task, std::chrono::nanoseconds period = std::chrono::nanoseconds(0))
+    {
+        std::shared_ptr<PeriodicTimerJob> periodic;
+        if(period.count() > 0)
+        {
+            periodic = std::make_shared<PeriodicTimerJob>(std::move(task));
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        uint32_t index = allocNode();
+        Node& n = node(index);
+        n.expire = tickOf(when);
+        n.period = period.count() > 0 ? std::max<uint64_t>(1, (uint64_t)(period / tick_)) : 0;
+        if(periodic)
+        {
+            n.periodic = std::move(periodic);
+        }
+        else
+        {
+            n.task = std::move(task);
+        }
+        link(index);
+        size_++;
+        return makeId(index, n.gen);
+    }
+
+    //从轮子上摘掉还没触发的定时器，一次性定时器的任务放进removed(为空时在锁外析构)
+    //已经触发、已经取消或者id无效时返回false
+    bool cancel(uint64_t id, TaskFunc* removed = nullptr)
+    {
+        TaskFunc task;
+        std::shared_ptr<PeriodicTimerJob> periodic;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            uint32_t index = (uint32_t)id;
+            if(index >= capacity() || node(index).gen != (uint32_t)(id >> 32) || node(index).level < 0)
+            {
+                return false;
+            }
+            Node& n = node(index);
+            unlink(index);
+            task = std::move(n.task);
+            periodic = std::move(n.periodic);
+            freeNode(index);
+            size_--;
+        }
+        if(periodic)
+        {
+            periodic->stopped.store(true, std::memory_order_release);
+        }
+        if(removed != nullptr)
+        {
+            *removed = std::move(task);
+        }
+        return true;
+    }
+
+    //处理到now为止到期的定时器，要执行的任务追加到due里，返回追加的数量
+    //一次性定时器的任务直接移出来；周期定时器生成一个调用共享任务的新任务，然后放回下一个周期的位置
+    size_t advance(Clock::time_point now, std::vector<TaskFunc>& due)
+    {
+        size_t before = due.size();
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(now < start_) return 0;
+        uint64_t target = (uint64_t)((now - start_) / tick_);
+        while(next_ <= target)
+        {
+            //轮子空了不用一格一格走
+            if(size_ == 0)
+            {
+                next_ = target + 1;
+                break;
+            }
+            uint64_t t = next_;
+            if((t & (TIMER_WHEEL_SLOTS - 1)) == 0)
+            {
+                cascade(t);
+            }
+            next_++;
+            //先把整个槽摘下来，周期定时器放回时可能正好落在同一个槽
+            uint32_t list = slots_[0][t & (TIMER_WHEEL_SLOTS - 1)];
+            slots_[0][t & (TIMER_WHEEL_SLOTS - 1)] = NIL;
+            while(list != NIL)
+            {
+                uint32_t index = list;
+                Node& n = node(index);
+                list = n.next;
+                n.prev = NIL;
+                n.next = NIL;
+                if(n.periodic)
+                {
+                    if(n.periodic->stopped.load(std::memory_order_acquire))
+                    {
+                        n.periodic.reset();
+                        freeNode(index);
+                        size_--;
+                        continue;
+                    }
+                    due.emplace_back([job = n.periodic]() { job->run(); });
+                    //固定频率，落后太多时跳过错过的周期
+                    n.expire += n.period;
+                    if(n.expire <= t) n.expire += ((t - n.expire) / n.period + 1) * n.period;
+                    link(index);
+                }
+                else
+                {
+                    due.push_back(std::move(n.task));
+                    freeNode(index);
+                    size_--;
+                }
+            }
+        }
+        return due.size() - before;
+    }
+
+    //下一次需要调用advance的时间：第0层这一圈里最近的非空槽，或者第0层转完一圈要级联的时候
+    //轮子为空时返回time_point::max()
+    Clock::time_point nextWakeup() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if(size_ == 0) return Clock::time_point::max();
+        uint64_t t = next_;
+        while((t & (TIMER_WHEEL_SLOTS - 1)) != 0 && slots_[0][t & (TIMER_WHEEL_SLOTS - 1)] == NIL)
+        {
+            t++;
+        }
+        return start_ + std::chrono::duration_cast<Clock::duration>(tick_ * t);
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return size_;
+    }
+
+    //摘掉所有还没触发的定时器，周期定时器停止，一次性定时器的任务追加到removed里，返回摘掉的数量
+    size_t clear(std::vector<TaskFunc>& removed)
+    {
+        std::vector<std::shared_ptr<PeriodicTimerJob>> periodic;
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            count = size_;
+            for(auto& level : slots_)
+            {
+                for(uint32_t& head : level)
+                {
+                    while(head != NIL)
+                    {
+                        uint32_t index = head;
+                        Node& n = node(index);
+                        head = n.next;
+                        if(n.periodic)
+                        {
+                            periodic.push_back(std::move(n.periodic));
+                        }
+                        else
+                        {
+                            removed.push_back(std::move(n.task));
+                        }
+                        n.prev = NIL;
+                        freeNode(index);
+                    }
+                }
+            }
+            size_ = 0;
+        }
+        for(auto& job : periodic)
+        {
+            job->stopped.store(true, std::memory_order_release);
+        }
+        return count;
+    }
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+    struct Node
+    {
+        TaskFunc task; //一次性定时器的任务
+        std::shared_ptr<PeriodicTimerJob> periodic; //周期定时器共享的任务
+        uint64_t expire = 0; //到期的tick
+        uint64_t period = 0; //周期，单位tick
+        uint32_t prev = NIL;
+        uint32_t next = NIL; //在槽里时是链表的后继，空闲时是空闲链表的后继
+        uint32_t gen = 0; //节点每次释放加一，旧id失效
+        int16_t level = -1; //所在的层，空闲为-1
+        uint16_t slot = 0;
+    };
+
+    static uint64_t makeId(uint32_t index, uint32_t gen)
+    {
+        return ((uint64_t)gen << 32) | index;
+    }
+
+    uint32_t capacity() const
+    {
+        return (uint32_t)(chunks_.size() * TIMER_CHUNK_NODES);
+    }
+
+    Node& node(uint32_t index)
+    {
+        return chunks_[index / TIMER_CHUNK_NODES][index % TIMER_CHUNK_NODES];
+    }
+
+    uint64_t tickOf(Clock::time_point when) const
+    {
+        if(when <= start_) return 0;
+        //向上取整，不会比要求的时间早触发
+        auto elapsed = when - start_;
+        uint64_t ticks = (uint64_t)(elapsed / tick_);
+        return elapsed % tick_ == Clock::duration::zero() ? ticks : ticks + 1;
+    }
+
+    uint32_t allocNode()
+    {
+        if(freeHead_ == NIL)
+        {
+            uint32_t base = capacity();
+            chunks_.emplace_back(new Node[TIMER_CHUNK_NODES]);
+            for(size_t i = TIMER_CHUNK_NODES; i-- > 0; )
+            {
+                Node& n = chunks_.back()[i];
+                n.next = freeHead_;
+                freeHead_ = base + (uint32_t)i;
+            }
+        }
+        uint32_t index = freeHead_;
+        freeHead_ = node(index).next;
+        return index;
+    }
+
+    void freeNode(uint32_t index)
+    {
+        Node& n = node(index);
+        n.gen++;
+        n.level = -1;
+        n.next = freeHead_;
+        freeHead_ = index;
+    }
+
+    //按到期时间和下一个要处理的tick的距离选层，已经过期的放到下一个要处理的槽
+    void link(uint32_t index)
+    {
+        Node& n = node(index);
+        uint64_t base = next_;
+        if(n.expire < base) n.expire = base;
+        uint64_t delta = n.expire - base;
+        int level = 0;
+        while(level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))))
+        {
+            level++;
+        }
+        uint64_t expire = n.expire;
+        uint64_t limit = (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+        if(delta >= limit)
+        {
+            //超出整个轮子的范围，先放在最高层最远的槽，转到时会重新计算
+            expire = base + limit - 1;
+        }
+        uint16_t slot = (uint16_t)((expire >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+        uint32_t& head = slots_[level][slot];
+        n.level = (int16_t)level;
+        n.slot = slot;
+        n.prev = NIL;
+        n.next = head;
+        if(head != NIL) node(head).prev = index;
+        head = index;
+    }
+
+    void unlink(uint32_t index)
+    {
+        Node& n = node(index);
+        if(n.prev != NIL)
+        {
+            node(n.prev).next = n.next;
+        }
+        else
+        {
+            slots_[n.level][n.slot] = n.next;
+        }
+        if(n.next != NIL)
+        {
+            node(n.next).prev = n.prev;
+        }
+        n.prev = NIL;
+        n.next = NIL;
+    }
+
+    //第0层转完一圈：上一层当前槽里的定时器重新放置，那一层也转完一圈时继续往上
+    //调用时next_等于t，上一层这个槽里的定时器都在[t, t+256)内到期，会落到第0层
+    void cascade(uint64_t t)
+    {
+        for(int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+        {
+            uint16_t slot = (uint16_t)((t >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+            uint32_t list = slots_[level][slot];
+            slots_[level][slot] = NIL;
+            while(list != NIL)
+            {
+                uint32_t index = list;
+                list = node(index).next;
+                link(index);
+            }
+            if(slot != 0) break;
+        }
+    }
+
+private:
+    const std::chrono::microseconds tick_;
+    const Clock::time_point start_;
+    uint64_t next_; //下一个要处理的tick
+    size_t size_;
+    std::vector<std::unique_ptr<Node[]>> chunks_;
+    uint32_t freeHead_;
+    uint32_t slots_[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    mutable std::mutex mtx_;
+};
+
+
+//定时器的句柄，可以复制；只弱引用时间轮，线程池销毁之后cancel()返回false
+class TimerHandle
+{
+public:
+    TimerHandle() : id_(0) {}
+    TimerHandle(std::weak_ptr<TimerWheel> wheel, uint64_t id) : wheel_(std::move(wheel)), id_(id) {}
+
+    //产生它的线程池还在；定时器本身可能已经触发或者取消
+    bool valid() const { return !wheel_.expired(); }
+
+    //从轮子上摘掉，之后不再触发(已经提交给线程池的那一次仍会执行)
+    //已经触发的一次性定时器、已经取消的定时器、线程池已经销毁时返回false
+    bool cancel(TaskFunc* removed = nullptr)
+    {
+        std::shared_ptr<TimerWheel> wheel = wheel_.lock();
+        return wheel != nullptr && wheel->cancel(id_, removed);
+    }
+
+private:
+    std::weak_ptr<TimerWheel> wheel_;
+    uint64_t id_;
+};
+
+
+//submitAfter/submitAt返回的future，到期前可以取消，取消后future得到TaskCancelledError
+template<typename T>
+class ScheduledFuture : public Future<T>
+{
+public:
+    ScheduledFuture() = default;
+    ScheduledFuture(Future<T>&& future, TimerHandle handle)
+        :Future<T>(std::move(future))
+        ,handle_(handle)
+    {}
+
+    //还没到期时从时间轮上摘掉；已经到期、还排在任务队列里时按Future::cancel()跳过
+    //已经开始执行或已经完成时返回false
+    //摘下来的任务在设置了取消结果之后才析构，它的promise不会再设置broken_promise
+    bool cancel()
+    {
+        TaskFunc task;
+        handle_.cancel(&task);
+        return Future<T>::cancel();
+    }
+
+    TimerHandle handle() const { return handle_; }
+
+private:
+    TimerHandle handle_;
+};
+
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <cstdlib>
+#include <cctype>
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#endif
+
+
+//解析"0-3,8,10-11"这种/sys里的cpu列表格式
+inline std::vector<int> parseCpuList(const std::string& text)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string item;
+    while(std::getline(ss, item, ','))
+    {
+        item.erase(std::remove_if(item.begin(), item.end(), [](char c){ return c == ' ' || c == '\n'; }), item.end());
+        if(item.empty()) continue;
+        size_t dash = item.find('-');
+        int first = std::atoi(item.substr(0, dash).c_str());
+        int last = dash == std::string::npos ? first : std::atoi(item.substr(dash + 1).c_str());
+        for(int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+//把调用线程绑定到一个cpu上，失败(cpu不存在或不在允许的集合里)返回false
+inline bool pinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    if(cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+//调用线程当前所在的cpu，取不到返回-1
+inline int currentCpu()
+{
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+
+//一个逻辑cpu在拓扑中的位置
+struct CpuInfo
+{
+    int cpu;
+    int node; //NUMA节点
+    int package; //物理封装(插槽)
+    int core; //封装内的核心编号，同一核心上的超线程相同
+};
+
+//CPU拓扑：从/sys读取在线cpu、所属封装、核心和NUMA节点，不依赖libnuma
+//读不到/sys时退化为hardware_concurrency个cpu都在节点0上
+class CpuTopology
+{
+public:
+    CpuTopology() = default;
+
+    //sysRoot默认是/sys/devices/system，测试时可以指向伪造的目录
+    static CpuTopology detect(const std::string& sysRoot = "/sys/devices/system")
+    {
+        CpuTopology topo;
+        std::vector<int> online = parseCpuList(readFile(sysRoot + "/cpu/online"));
+        if(online.empty())
+        {
+            int n = (int)std::max(1u, std::thread::hardware_concurrency());
+            for(int i = 0; i < n; i++) online.push_back(i);
+        }
+
+        std::map<int, int> nodeOfCpu;
+        for(int node : listNodes(sysRoot))
+        {
+            std::string path = sysRoot + "/node/node" + std::to_string(node) + "/cpulist";
+            for(int cpu : parseCpuList(readFile(path))) nodeOfCpu[cpu] = node;
+        }
+
+        for(int cpu : online)
+        {
+            std::string dir = sysRoot + "/cpu/cpu" + std::to_string(cpu) + "/topology/";
+            CpuInfo info;
+            info.cpu = cpu;
+            info.node = nodeOfCpu.count(cpu) ? nodeOfCpu[cpu] : 0;
+            info.package = readInt(dir + "physical_package_id", 0);
+            info.core = readInt(dir + "core_id", cpu);
+            topo.cpus_.push_back(info);
+        }
+        topo.finish();
+        return topo;
+    }
+
+    //本机拓扑，第一次调用时读取
+    static const CpuTopology& system()
+    {
+        static const CpuTopology topo = detect();
+        return topo;
+    }
+
+    //直接给出cpu列表构造，用于测试或者容器里/sys不可信的情况
+    static CpuTopology fromCpus(std::vector<CpuInfo> cpus)
+    {
+        CpuTopology topo;
+        topo.cpus_ = std::move(cpus);
+        topo.finish();
+        return topo;
+    }
+
+    const std::vector<CpuInfo>& cpus() const { return cpus_; }
+
+    //节点编号重新映射成0..nodeCount()-1
+    int nodeCount() const { return (int)nodeIds_.size(); }
+
+    //cpu所在节点的编号(0..nodeCount()-1)，未知的cpu算节点0
+    //提交任务时会用到，查表
+    int nodeOf(int cpu) const
+    {
+        if(cpu < 0 || cpu >= (int)nodeByCpu_.size()) return 0;
+        return nodeByCpu_[cpu];
+    }
+
+    //紧凑排列：按节点、封装、核心依次填满，同一核心的超线程相邻，适合共享缓存的任务
+    std::vector<int> compactOrder() const
+    {
+        std::vector<CpuInfo> sorted = cpus_;
+        std::sort(sorted.begin(), sorted.end(), [](const CpuInfo& a, const CpuInfo& b)
+        {
+            if(a.node != b.node) return a.node < b.node;
+            if(a.package != b.package) return a.package < b.package;
+            if(a.core != b.core) return a.core < b.core;
+            return a.cpu < b.cpu;
+        });
+        std::vector<int> order;
+        for(const CpuInfo& info : sorted) order.push_back(info.cpu);
+        return order;
+    }
+
+    //分散排列：先在节点之间轮流，再在核心之间轮流，最后才用到同一核心的第二个超线程，适合吃内存带宽的任务
+    std::vector<int> scatterOrder() const
+    {
+        //nodes[节点][核心] = 这个核心上的cpu列表
+        std::vector<std::vector<std::vector<int>>> nodes(nodeIds_.size());
+        std::map<std::pair<int, std::pair<int, int>>, size_t> coreIndex;
+        for(const CpuInfo& info : compactSorted())
+        {
+            int n = denseNode(info.node);
+            auto key = std::make_pair(n, std::make_pair(info.package, info.core));
+            auto it = coreIndex.find(key);
+            if(it == coreIndex.end())
+            {
+                it = coreIndex.emplace(key, nodes[n].size()).first;
+                nodes[n].emplace_back();
+            }
+            nodes[n][it->second].push_back(info.cpu);
+        }
+
+        std::vector<int> order;
+        for(size_t thread = 0; order.size() < cpus_.size(); thread++)
+        {
+            size_t maxCores = 0;
+            for(auto& cores : nodes) maxCores = std::max(maxCores, cores.size());
+            for(size_t core = 0; core < maxCores; core++)
+            {
+                for(auto& cores : nodes)
+                {
+                    if(core < cores.size() && thread < cores[core].size())
+                    {
+                        order.push_back(cores[core][thread]);
+                    }
+                }
+            }
+        }
+        return order;
+    }
+
+private:
+    static std::string readFile(const std::string& path)
+    {
+        std::ifstream in(path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    static int readInt(const std::string& path, int fallback)
+    {
+        std::string text = readFile(path);
+        if(text.empty()) return fallback;
+        return std::atoi(text.c_str());
+    }
+
+    static std::vector<int> listNodes(const std::string& sysRoot)
+    {
+        std::vector<int> nodes;
+#ifdef __linux__
+        DIR* dir = opendir((sysRoot + "/node").c_str());
+        if(dir == nullptr) return nodes;
+        while(struct dirent* ent = readdir(dir))
+        {
+            std::string name = ent->d_name;
+            if(name.size() > 4 && name.compare(0, 4, "node") == 0 && std::isdigit((unsigned char)name[4]))
+            {
+                nodes.push_back(std::atoi(name.c_str() + 4));
+            }
+        }
+        closedir(dir);
+        std::sort(nodes.begin(), nodes.end());
+#endif
+        return nodes;
+    }
+
+    std::vector<CpuInfo> compactSorted() const
+    {
+        std::vector<CpuInfo> sorted;
+        for(int cpu : compactOrder())
+        {
+            for(const CpuInfo& info : cpus_)
+            {
+                if(info.cpu == cpu) sorted.push_back(info);
+            }
+        }
+        return sorted;
+    }
+
+    int denseNode(int node) const
+    {
+        auto it = std::lower_bound(nodeIds_.begin(), nodeIds_.end(), node);
+        return it != nodeIds_.end() && *it == node ? (int)(it - nodeIds_.begin()) : 0;
+    }
+
+    void finish()
+    {
+        nodeIds_.clear();
+        for(const CpuInfo& info : cpus_) nodeIds_.push_back(info.node);
+        std::sort(nodeIds_.begin(), nodeIds_.end());
+        nodeIds_.erase(std::unique(nodeIds_.begin(), nodeIds_.end()), nodeIds_.end());
+        if(nodeIds_.empty()) nodeIds_.push_back(0);
+
+        nodeByCpu_.clear();
+        for(const CpuInfo& info : cpus_)
+        {
+            if(info.cpu < 0) continue;
+            if(info.cpu >= (int)nodeByCpu_.size()) nodeByCpu_.resize(info.cpu + 1, 0);
+            nodeByCpu_[info.cpu] = denseNode(info.node);
+        }
+    }
+
+private:
+    std::vector<CpuInfo> cpus_;
+    std::vector<int> nodeIds_; //出现过的节点编号，升序
+    std::vector<int> nodeByCpu_; //cpu编号 -> 重新映射后的节点编号
+};
+
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+
+
+//Chase-Lev工作窃取双端队列
+//owner线程在bottom端push/pop(LIFO)，其他线程在top端steal(FIFO)
+//参考：Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing for Weak Memory Models"
+//元素必须是可平凡拷贝的类型(一般存指针)，窃取方可能读到随即被覆盖的槽位，CAS失败后丢弃
+template<typename T>
+class WorkStealingDeque
+{
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque element must be trivially copyable");
+
+public:
+    explicit WorkStealingDeque(int64_t capacity = 256)
+        :top_(0)
+        ,bottom_(0)
+    {
+        int64_t cap = 1;
+        while(cap < capacity) cap <<= 1;
+        auto arr = std::make_unique<Array>(cap);
+        array_.store(arr.get(), std::memory_order_relaxed);
+        garbage_.emplace_back(std::move(arr));
+    }
+    ~WorkStealingDeque() = default;
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    //只能由owner线程调用
+    void push(T item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* a = array_.load(std::memory_order_relaxed);
+        if(b - t > a->capacity() - 1)
+        {
+            //队列满，扩容；旧数组可能还在被窃取方读取，保留到析构时释放
+            auto bigger = a->grow(b, t);
+            a = bigger.get();
+            garbage_.emplace_back(std::move(bigger));
+            array_.store(a, std::memory_order_release);
+        }
+        a->put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    //只能由owner线程调用，队列为空返回false
+    bool pop(T& item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if(t > b)
+        {
+            //队列为空，恢复bottom
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = a->get(b);
+        if(t == b)
+        {
+            //最后一个元素，和窃取方竞争
+            bool won = top_.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    //任意线程调用，失败(为空或竞争失败)返回false
+    bool steal(T& item)
+    {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b)
+        {
+            return false;
+        }
+
+        Array* a = array_.load(std::memory_order_acquire);
+        T x = a->get(t);
+        if(!top_.compare_exchange_strong(t, t + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        item = x;
+        return true;
+    }
+
+    //近似大小，只用于判断是否值得窃取
+    int64_t size() const
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? b - t : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    //环形数组，容量为2的幂
+    class Array
+    {
+    public:
+        explicit Array(int64_t cap)
+            :cap_(cap)
+            ,mask_(cap - 1)
+            ,buf_(new std::atomic<T>[cap])
+        {}
+
+        int64_t capacity() const { return cap_; }
+
+        T get(int64_t i) const
+        {
+            return buf_[i & mask_].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t i, T x)
+        {
+            buf_[i & mask_].store(x, std::memory_order_relaxed);
+        }
+
+        std::unique_ptr<Array> grow(int64_t b, int64_t t) const
+        {
+            auto a = std::make_unique<Array>(cap_ * 2);
+            for(int64_t i = t; i < b; i++)
+            {
+                a->put(i, get(i));
+            }
+            return a;
+        }
+
+    private:
+        int64_t cap_;
+        int64_t mask_;
+        std::unique_ptr<std::atomic<T>[]> buf_;
+    };
+
+    alignas(64) std::atomic<int64_t> top_;      //窃取端
+    alignas(64) std::atomic<int64_t> bottom_;   //owner端
+    alignas(64) std::atomic<Array*> array_;
+    std::vector<std::unique_ptr<Array>> garbage_; //所有分配过的数组，只有owner修改
+};
+
+
+#endif